@@ -40,6 +40,16 @@ enum SpdyErrors {
     kSpdyInvalidResponseHeaders = 4,
 };
 
+// Counters for server pushed streams.  Unused bytes were received for pushes that no request claimed before they were
+// dropped from the push cache.
+typedef struct {
+    NSUInteger pushedStreams;
+    NSUInteger claimedStreams;
+    NSUInteger droppedStreams;
+    NSUInteger bufferedBytes;
+    NSUInteger unusedBytes;
+} SpdyPushMetrics;
+
 @protocol SpdyRequestIdentifier <NSObject>
 - (NSURL *)url;
 - (void)close;
@@ -77,13 +87,51 @@ enum SpdyErrors {
 - (void)fetchFromMessage:(CFHTTPMessageRef)request delegate:(RequestCallback *)delegate;
 - (void)fetchFromRequest:(NSURLRequest *)request delegate:(RequestCallback *)delegate;
 
+// Opens sessions for the host:port of each NSURL in urls before any request is made so that the first fetch does not
+// wait for DNS, TCP, TLS and NPN.  With warmUp a PING is sent as soon as spdy is negotiated.  A preconnected session
+// that has not carried a request after preconnectTimeout seconds is closed.  Host names are resolved asynchronously on
+// the current run loop, so the sessions are opened some time after this returns.  Failures are only logged.
+- (void)preconnect:(NSArray *)urls;
+- (void)preconnect:(NSArray *)urls warmUp:(BOOL)warmUp;
+
+// Returns YES if a connected session for url.host:url.port exists, e.g. once a preconnect has finished.
+- (BOOL)isSessionReadyForURL:(NSURL *)url;
+
 // Cancels all active requests and closes all connections.  Returns the number of requests that were cancelled.  Ideally this should be called when all requests have already been canceled.
 - (NSInteger)closeAllSessions;
 
-// Like closeAllSessions above, but only cancels and closes for url.host:url.port.
+// Like closeAllSessions above, but only cancels and closes for url.host:url.port.  With coalesceOrigins this also closes
+// the session for any other host coalesced onto the same session.
 - (NSInteger)closeAllSessionsForURL:(NSURL *)url;
 
 @property (retain) NSObject<SpdyLogger> *logger;
+
+// When set, every new session writes the decrypted bytes it reads to a host-port-N.spdycap file in captureDirectory.
+// The captures can be replayed with SpdyReplaySession to profile frame processing without the network.
+@property (retain) NSString *captureDirectory;
+
+// How long a preconnected session may stay unused before it is closed.  Defaults to 30 seconds.
+@property (assign) NSTimeInterval preconnectTimeout;
+
+// Server push is off by default and pushed streams are refused.  When enabled, pushed responses are kept in a push cache
+// of at most pushCacheMaxBytes (1MB by default) and a later GET for the same url is served from the cache, or attached
+// to the push while it is still being received, instead of going to the network.
+@property (nonatomic, assign) BOOL serverPushEnabled;
+@property (assign) NSUInteger pushCacheMaxBytes;
+- (SpdyPushMetrics)pushMetrics;
+
+// Request coalescing is off by default.  When on, identical GET and HEAD requests that are in flight at the same time
+// share one stream and the response is delivered to every delegate.  Requests are identical when the method, url and
+// the values of the coalescingHeaders (matched case insensitively) are the same.  A request can only join a shared
+// stream until its response headers arrive.  Ranged and conditional requests are never coalesced.
+@property (assign) BOOL coalesceRequests;
+@property (retain) NSArray *coalescingHeaders;
+
+// Origin coalescing is off by default.  When on, a request for a host without a session reuses a connected session
+// whose server resolves to the same ip and port and whose certificate covers the host (for example a wildcard
+// certificate shared by CDN shards), instead of opening a new connection.  Note that the certificate is not verified
+// by this library, so only enable this for hosts that are trusted.
+@property (assign) BOOL coalesceOrigins;
 @end
 
 @interface RequestCallback : NSObject {
@@ -34,7 +34,9 @@
 #include "spdylay/spdylay.h"
 
 #import "SpdySession.h"
+#import "SpdyCoalescedRequest.h"
 #import "SpdyInputStream.h"
+#import "SpdyPushCache.h"
 #import "SpdyStream.h"
 #import "SpdyUrlConnection.h"
 #import "SpdySessionKey.h"
@@ -74,20 +76,39 @@ static int select_next_proto_cb(SSL *ssl,
 
 @interface SPDY ()
 - (void)fetchFromMessage:(CFHTTPMessageRef)request delegate:(RequestCallback *)delegate body:(NSInputStream *)body;
+- (BOOL)fetchFromPushCache:(NSURL *)url method:(NSString *)method delegate:(RequestCallback *)delegate;
+- (BOOL)joinInflightRequest:(NSURL *)url method:(NSString *)method headers:(NSDictionary *)headers delegate:(RequestCallback **)delegate;
 + (SpdyNetworkStatus)reachabilityStatusForHost:(NSString *)host;
+- (void)closeUnusedSession:(SpdySessionKey *)key;
+- (SpdySession *)getSession:(NSURL *)url address:(NSData *)address withError:(NSError **)error;
+- (void)preconnect:(NSURL *)url address:(NSData *)address warmUp:(BOOL)warmUp;
+- (SpdySession *)coalescedSessionForUrl:(NSURL *)url address:(NSString *)address;
+- (void)removeSession:(SpdySession *)session;
 
 - (void)setUpSslCtx;
 
 @property (nonatomic, retain) NSMutableDictionary *sessions;
 @property (nonatomic, assign) SSL_CTX *ssl_ctx;
+@property (nonatomic, assign) NSUInteger captureCount;
+@property (nonatomic, retain) SpdyPushCache *pushCache;
+@property (nonatomic, retain) NSMutableDictionary *inflightRequests;
 
 @end
 
 @implementation SPDY
 
 @synthesize logger = _logger;
+@synthesize captureDirectory = _captureDirectory;
+@synthesize preconnectTimeout = _preconnectTimeout;
 @synthesize sessions = _sessions;
 @synthesize ssl_ctx =  _ssl_ctx;
+@synthesize captureCount = _captureCount;
+@synthesize pushCache = _pushCache;
+@synthesize serverPushEnabled = _serverPushEnabled;
+@synthesize coalesceRequests = _coalesceRequests;
+@synthesize coalescingHeaders = _coalescingHeaders;
+@synthesize inflightRequests = _inflightRequests;
+@synthesize coalesceOrigins = _coalesceOrigins;
 
 // This logic was stripped from Apple's Reachability.m sample application.
 + (SpdyNetworkStatus)networkStatusForReachabilityFlags:(SCNetworkReachabilityFlags)flags {
@@ -127,6 +148,11 @@ static int select_next_proto_cb(SSL *ssl,
 }
 
 - (SpdySession *)getSession:(NSURL *)url withError:(NSError **)error {
+    return [self getSession:url address:nil withError:error];
+}
+
+// address may already be resolved, otherwise it is resolved here if needed.
+- (SpdySession *)getSession:(NSURL *)url address:(NSData *)address withError:(NSError **)error {
     assert(error != NULL);
     SpdySessionKey *key = [[[SpdySessionKey alloc] initFromUrl:url] autorelease];
     SpdySession *session = [self.sessions objectForKey:key];
@@ -137,12 +163,32 @@ static int select_next_proto_cb(SSL *ssl,
         SPDY_LOG(@"Resetting %@ because invalid: %i or %d != %d", session, [session isInvalid], currentStatus, session.networkStatus);
         [session resetStreamsAndGoAway];
         oldSslSession = [session getSslSession];
-        [self.sessions removeObjectForKey:key];
+        [self removeSession:session];
         session = nil;
     }
+    // The address is resolved once, both to look for a session to coalesce onto and to connect a new session.
+    if (session == nil && self.coalesceOrigins) {
+        if (address == nil)
+            address = [SpdySession addressForUrl:url error:error];
+        if (address == nil) {
+            if (oldSslSession != NULL)
+                SSL_SESSION_free(oldSslSession);
+            return nil;
+        }
+        session = [self coalescedSessionForUrl:url address:[SpdySession stringForAddress:address]];
+        if (session != nil) {
+            [self.sessions setObject:session forKey:key];
+            if (oldSslSession != NULL)
+                SSL_SESSION_free(oldSslSession);  // Only a new session would have taken this reference.
+        }
+    }
     if (session == nil) {
         session = [[[SpdySession alloc] init:self.ssl_ctx oldSession:oldSslSession] autorelease];
-        *error = [session connect:url];
+        if (self.captureDirectory != nil) {
+            NSString *name = [NSString stringWithFormat:@"%@-%@-%u.spdycap", key.host, key.port ? key.port : [NSNumber numberWithInt:443], self.captureCount++];
+            [session captureToFile:[self.captureDirectory stringByAppendingPathComponent:name]];
+        }
+        *error = address != nil ? [session connect:url address:address] : [session connect:url];
         if (*error != nil) {
             SPDY_LOG(@"Could not connect to %@ because %@", url, *error);
             return nil;
@@ -153,9 +199,158 @@ static int select_next_proto_cb(SSL *ssl,
         [self.sessions setObject:session forKey:key];
         [session addToLoop];
     }
+    session.pushCache = self.serverPushEnabled ? self.pushCache : nil;
     return session;
 }
 
+- (void)preconnect:(NSArray *)urls {
+    [self preconnect:urls warmUp:NO];
+}
+
+static void preconnect_resolved(CFHostRef host, CFHostInfoType typeInfo, const CFStreamError *error, void *info) {
+    NSArray *request = [[(NSArray *)info retain] autorelease];
+    SPDY *spdy = [request objectAtIndex:0];
+    NSURL *url = [request objectAtIndex:1];
+    BOOL warmUp = [[request objectAtIndex:2] boolValue];
+    NSData *address = nil;
+    if (error == NULL || error->error == 0) {
+        Boolean resolved = false;
+        NSArray *addresses = (NSArray *)CFHostGetAddressing(host, &resolved);
+        if (resolved)
+            address = [SpdySession addressForUrl:url fromHostAddresses:addresses];
+    }
+    CFHostSetClient(host, NULL, NULL);
+    CFHostUnscheduleFromRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
+    CFRelease(host);  // Taken in preconnect:warmUp:.
+
+    if (address == nil) {
+        SPDY_LOG(@"Preconnect could not resolve %@ (domain %ld, error %d)", url.host, error ? error->domain : 0, error ? (int)error->error : 0);
+        return;
+    }
+    [spdy preconnect:url address:address warmUp:warmUp];
+}
+
+- (void)preconnect:(NSArray *)urls warmUp:(BOOL)warmUp {
+    for (NSURL *url in urls) {
+        if (url.host == nil)
+            continue;
+        // Resolve on the run loop so that the caller never blocks on DNS.
+        NSArray *request = [NSArray arrayWithObjects:self, url, [NSNumber numberWithBool:warmUp], nil];
+        CFHostClientContext context = {0, request, CFRetain, CFRelease, NULL};
+        CFHostRef host = CFHostCreateWithName(NULL, (CFStringRef)url.host);
+        CFHostSetClient(host, preconnect_resolved, &context);
+        CFHostScheduleWithRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
+        CFStreamError error;
+        if (!CFHostStartInfoResolution(host, kCFHostAddresses, &error)) {
+            SPDY_LOG(@"Could not start resolving %@ for preconnect (domain %ld, error %d)", url.host, error.domain, (int)error.error);
+            CFHostSetClient(host, NULL, NULL);
+            CFHostUnscheduleFromRunLoop(host, CFRunLoopGetCurrent(), kCFRunLoopCommonModes);
+            CFRelease(host);
+        }
+    }
+}
+
+- (void)preconnect:(NSURL *)url address:(NSData *)address warmUp:(BOOL)warmUp {
+    NSError *error = nil;
+    SpdySession *session = [self getSession:url address:address withError:&error];
+    if (session == nil) {
+        SPDY_LOG(@"Could not preconnect to %@: %@", url, error);
+        return;
+    }
+    if (session.streamCount > 0)
+        return;
+    if (warmUp)
+        [session warmUp];
+    SPDY_LOG(@"Preconnecting %@ to %@", url, session);
+    SpdySessionKey *key = [[[SpdySessionKey alloc] initFromUrl:url] autorelease];
+    // A timer from an earlier preconnect of this host must not close the session early.
+    [NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(closeUnusedSession:) object:key];
+    [self performSelector:@selector(closeUnusedSession:) withObject:key afterDelay:self.preconnectTimeout];
+}
+
+- (void)closeUnusedSession:(SpdySessionKey *)key {
+    SpdySession *session = [self.sessions objectForKey:key];
+    if (session != nil && session.streamCount == 0) {
+        SPDY_LOG(@"Closing unused preconnected session %@", session);
+        [session resetStreamsAndGoAway];
+        [self removeSession:session];
+    }
+}
+
+- (BOOL)isSessionReadyForURL:(NSURL *)url {
+    if (url.host == nil)
+        return NO;
+    SpdySessionKey *key = [[[SpdySessionKey alloc] initFromUrl:url] autorelease];
+    SpdySession *session = [self.sessions objectForKey:key];
+    return session != nil && session.connectState == CONNECTED && ![session isInvalid];
+}
+
+- (void)setServerPushEnabled:(BOOL)enabled {
+    _serverPushEnabled = enabled;
+    for (SpdySession *session in [NSSet setWithArray:[self.sessions allValues]]) {
+        session.pushCache = enabled ? self.pushCache : nil;
+    }
+    if (!enabled)
+        [self.pushCache removeAll];
+}
+
+- (NSUInteger)pushCacheMaxBytes {
+    return self.pushCache.maxBytes;
+}
+
+- (void)setPushCacheMaxBytes:(NSUInteger)maxBytes {
+    self.pushCache.maxBytes = maxBytes;
+}
+
+- (SpdyPushMetrics)pushMetrics {
+    return self.pushCache.metrics;
+}
+
+// Returns YES if delegate was attached to a pushed response for url.
+- (BOOL)fetchFromPushCache:(NSURL *)url method:(NSString *)method delegate:(RequestCallback *)delegate {
+    if (!self.serverPushEnabled || ![method isEqualToString:@"GET"])
+        return NO;
+    return [self.pushCache claim:url delegate:delegate];
+}
+
+// Returns YES if delegate joined an identical in-flight request.  Otherwise *delegate may be replaced with the shared
+// callback that the new stream has to report to.
+- (BOOL)joinInflightRequest:(NSURL *)url method:(NSString *)method headers:(NSDictionary *)headers delegate:(RequestCallback **)delegate {
+    if (!self.coalesceRequests || !([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"]))
+        return NO;
+    if (![SpdyCoalescedRequest canCoalesceHeaders:headers])
+        return NO;
+    NSString *key = [SpdyCoalescedRequest keyForUrl:url method:method headers:headers varyHeaders:self.coalescingHeaders];
+    SpdyCoalescedRequest *shared = [self.inflightRequests objectForKey:key];
+    if ([shared addWaiter:*delegate]) {
+        SPDY_LOG(@"Coalesced request for %@ onto %@", url, shared);
+        return YES;
+    }
+    shared = [[[SpdyCoalescedRequest alloc] initWithKey:key url:url table:self.inflightRequests] autorelease];
+    [shared addWaiter:*delegate];
+    [self.inflightRequests setObject:shared forKey:key];
+    *delegate = shared;
+    return NO;
+}
+
+// Looks for a connected session to address (ip:port) whose certificate also covers url.host.
+- (SpdySession *)coalescedSessionForUrl:(NSURL *)url address:(NSString *)address {
+    for (SpdySession *session in [NSSet setWithArray:[self.sessions allValues]]) {
+        if (session.connectState != CONNECTED || [session isInvalid])
+            continue;
+        if ([address isEqualToString:session.peerAddress] && [session certificateMatchesHost:url.host]) {
+            SPDY_LOG(@"Coalescing %@ onto %@ at %@", url.host, session, address);
+            return session;
+        }
+    }
+    return nil;
+}
+
+// Removes every key that maps to session.
+- (void)removeSession:(SpdySession *)session {
+    [self.sessions removeObjectsForKeys:[self.sessions allKeysForObject:session]];
+}
+
 - (void)fetch:(NSString *)url delegate:(RequestCallback *)delegate {
     NSURL *u = [NSURL URLWithString:url];
     if (u == nil || u.host == nil) {
@@ -163,6 +358,10 @@ static int select_next_proto_cb(SSL *ssl,
         [delegate onError:error];
         return;
     }
+    if ([self fetchFromPushCache:u method:@"GET" delegate:delegate])
+        return;
+    if ([self joinInflightRequest:u method:@"GET" headers:nil delegate:&delegate])
+        return;
     NSError *error;
     SpdySession *session = [self getSession:u withError:&error];
     if (session == nil) {
@@ -178,7 +377,20 @@ static int select_next_proto_cb(SSL *ssl,
 
 - (void)fetchFromMessage:(CFHTTPMessageRef)request delegate:(RequestCallback *)delegate body:(NSInputStream *)body {
     CFURLRef url = CFHTTPMessageCopyRequestURL(request);
+    NSString *method = [NSMakeCollectable(CFHTTPMessageCopyRequestMethod(request)) autorelease];
     NSError *error;
+    if (body == nil && [self fetchFromPushCache:(NSURL *)url method:method delegate:delegate]) {
+        CFRelease(url);
+        return;
+    }
+    NSData *messageBody = [NSMakeCollectable(CFHTTPMessageCopyBody(request)) autorelease];
+    if (body == nil && [messageBody length] == 0) {
+        NSDictionary *headers = [NSMakeCollectable(CFHTTPMessageCopyAllHeaderFields(request)) autorelease];
+        if ([self joinInflightRequest:(NSURL *)url method:method headers:headers delegate:&delegate]) {
+            CFRelease(url);
+            return;
+        }
+    }
     SpdySession *session = [self getSession:(NSURL *)url withError:&error];
     if (session == nil) {
         [delegate onError:error];
@@ -191,6 +403,11 @@ static int select_next_proto_cb(SSL *ssl,
 - (void)fetchFromRequest:(NSURLRequest *)request delegate:(RequestCallback *)delegate {
     NSURL *url = [request URL];
     NSError *error;
+    if ([self fetchFromPushCache:url method:[request HTTPMethod] delegate:delegate])
+        return;
+    if (request.HTTPBody == nil && request.HTTPBodyStream == nil &&
+        [self joinInflightRequest:url method:[request HTTPMethod] headers:[request allHTTPHeaderFields] delegate:&delegate])
+        return;
     SpdySession *session = [self getSession:(NSURL *)url withError:&error];
     if (session == nil) {
         [delegate onError:error];
@@ -201,7 +418,8 @@ static int select_next_proto_cb(SSL *ssl,
 
 - (NSInteger)closeAllSessions {
     NSInteger cancelledRequests = 0;
-    NSEnumerator *enumerator = [self.sessions objectEnumerator];
+    // A session coalesced for several hosts is in sessions once for each host.
+    NSEnumerator *enumerator = [[NSSet setWithArray:[self.sessions allValues]] objectEnumerator];
     SpdySession *session;
     
     while ((session = (SpdySession *)[enumerator nextObject])) {
@@ -217,7 +435,7 @@ static int select_next_proto_cb(SSL *ssl,
     SpdySession *session = [self.sessions objectForKey:urlKey];
     if (session != nil) {
         cancelledRequests = [session resetStreamsAndGoAway];
-        [self.sessions removeObjectForKey:urlKey];
+        [self removeSession:session];
     }
     return cancelledRequests;
     
@@ -228,6 +446,10 @@ static int select_next_proto_cb(SSL *ssl,
     if (self) {
         self.logger = [[[SpdyLogImpl alloc] init] autorelease];
         self.sessions = [[NSMutableDictionary alloc] init];
+        self.preconnectTimeout = 30;
+        self.pushCache = [[[SpdyPushCache alloc] initWithMaxBytes:1024 * 1024 maxEntries:64] autorelease];
+        self.inflightRequests = [NSMutableDictionary dictionary];
+        self.coalescingHeaders = [NSArray arrayWithObjects:@"accept", @"accept-encoding", @"accept-language", @"authorization", @"cookie", nil];
         [self setUpSslCtx];
     }
     return self;
@@ -235,6 +457,10 @@ static int select_next_proto_cb(SSL *ssl,
 
 - (void)dealloc {
     [_logger release];
+    [_captureDirectory release];
+    [_pushCache release];
+    [_inflightRequests release];
+    [_coalescingHeaders release];
     [_sessions release];
     SSL_CTX_free(_ssl_ctx);
     [super dealloc];
@@ -0,0 +1,40 @@
+//
+//  SpdyCoalescedRequest.h
+//  A RequestCallback that fans a single stream out to every request that was coalesced onto it.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import "SPDY.h"
+
+// Each waiter gets its own SpdyRequestIdentifier in onConnect.  Closing it only cancels that waiter, the shared stream
+// is cancelled once no waiters are left.
+@interface SpdyCoalescedRequest : RequestCallback
+
+// The request removes itself from table once it can no longer be joined.
+- (SpdyCoalescedRequest *)initWithKey:(NSString *)key url:(NSURL *)url table:(NSMutableDictionary *)table;
+
+// Returns NO if the response has already started and delegate has to make its own request.
+- (BOOL)addWaiter:(RequestCallback *)delegate;
+
+// Identical requests have the same key.  Header names in headers and varyHeaders are matched case insensitively.
++ (NSString *)keyForUrl:(NSURL *)url method:(NSString *)method headers:(NSDictionary *)headers varyHeaders:(NSArray *)varyHeaders;
+
+// Returns NO for ranged and conditional requests, which may get a 206 or 304 that is wrong for a plain request.
++ (BOOL)canCoalesceHeaders:(NSDictionary *)headers;
+
+@property (readonly) NSUInteger waiterCount;
+
+@end
@@ -0,0 +1,215 @@
+//
+//  SpdyCoalescedRequest.m
+//  Waiters can only join before the response headers arrive so that nothing has to be buffered for late waiters.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyCoalescedRequest.h"
+
+@interface SpdyCoalescedWaiter : NSObject<SpdyRequestIdentifier>
+@property (assign) SpdyCoalescedRequest *request;
+@property (retain) RequestCallback *delegate;
+@property (retain) NSURL *url;
+@end
+
+@interface SpdyCoalescedRequest ()
+- (void)removeWaiter:(SpdyCoalescedWaiter *)waiter;
+- (NSArray *)finish;
+
+@property (retain) NSString *key;
+@property (retain) NSURL *url;
+@property (assign) NSMutableDictionary *table;
+@property (retain) id<SpdyRequestIdentifier> stream;
+@property (assign) BOOL responseStarted;
+@end
+
+@implementation SpdyCoalescedWaiter
+@synthesize request = _request;
+@synthesize delegate = _delegate;
+@synthesize url = _url;
+
+- (void)dealloc {
+    [_delegate release];
+    [_url release];
+    [super dealloc];
+}
+
+- (void)close {
+    [self.request removeWaiter:self];
+}
+
+@end
+
+@implementation SpdyCoalescedRequest {
+    NSMutableArray *waiters;
+}
+
+@synthesize key = _key;
+@synthesize url = _url;
+@synthesize table = _table;
+@synthesize stream = _stream;
+@synthesize responseStarted = _responseStarted;
+
+- (SpdyCoalescedRequest *)initWithKey:(NSString *)key url:(NSURL *)url table:(NSMutableDictionary *)table {
+    self = [super init];
+    if (self != nil) {
+        self.key = key;
+        self.url = url;
+        self.table = table;
+        waiters = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (SpdyCoalescedWaiter *waiter in waiters) {
+        waiter.request = nil;
+    }
+    [waiters release];
+    [_key release];
+    [_url release];
+    [_stream release];
+    [super dealloc];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"%@: %@ with %u waiters", [super description], self.key, [waiters count]];
+}
+
++ (NSString *)keyForUrl:(NSURL *)url method:(NSString *)method headers:(NSDictionary *)headers varyHeaders:(NSArray *)varyHeaders {
+    NSMutableDictionary *lowercaseHeaders = [NSMutableDictionary dictionaryWithCapacity:[headers count]];
+    for (NSString *name in headers) {
+        [lowercaseHeaders setObject:[headers objectForKey:name] forKey:[name lowercaseString]];
+    }
+    NSMutableString *key = [NSMutableString stringWithFormat:@"%@ %@\n", method, [url absoluteString]];
+    for (NSString *name in varyHeaders) {
+        name = [name lowercaseString];
+        NSString *value = [lowercaseHeaders objectForKey:name];
+        if (value != nil)
+            [key appendFormat:@"%@: %@\n", name, value];
+    }
+    return key;
+}
+
++ (BOOL)canCoalesceHeaders:(NSDictionary *)headers {
+    static NSSet *uncoalescable = nil;
+    if (uncoalescable == nil)
+        uncoalescable = [[NSSet alloc] initWithObjects:@"range", @"if-range", @"if-match", @"if-none-match", @"if-modified-since", @"if-unmodified-since", nil];
+    for (NSString *name in headers) {
+        if ([uncoalescable containsObject:[name lowercaseString]])
+            return NO;
+    }
+    return YES;
+}
+
+- (NSUInteger)waiterCount {
+    return [waiters count];
+}
+
+- (BOOL)addWaiter:(RequestCallback *)delegate {
+    if (self.responseStarted || self.table == nil)
+        return NO;
+    SpdyCoalescedWaiter *waiter = [[[SpdyCoalescedWaiter alloc] init] autorelease];
+    waiter.request = self;
+    waiter.delegate = delegate;
+    waiter.url = self.url;
+    [waiters addObject:waiter];
+    if (self.stream != nil)
+        [delegate onConnect:waiter];
+    return YES;
+}
+
+- (void)removeWaiter:(SpdyCoalescedWaiter *)waiter {
+    if ([waiters indexOfObjectIdenticalTo:waiter] == NSNotFound)
+        return;
+    [[waiter retain] autorelease];
+    [waiters removeObjectIdenticalTo:waiter];
+    waiter.request = nil;
+    [waiter.delegate onError:[NSError errorWithDomain:kSpdyErrorDomain code:kSpdyRequestCancelled userInfo:nil]];
+    if ([waiters count] == 0) {
+        SPDY_LOG(@"Last waiter for %@ cancelled", self);
+        id<SpdyRequestIdentifier> stream = [[self.stream retain] autorelease];
+        [self finish];
+        [stream close];
+    }
+}
+
+// Removes the request from the table and returns the waiters that still need to be told how the request ended.
+- (NSArray *)finish {
+    [[self retain] autorelease];
+    if (self.table != nil && [self.table objectForKey:self.key] == self)
+        [self.table removeObjectForKey:self.key];
+    self.table = nil;
+    NSArray *finished = [[waiters copy] autorelease];
+    for (SpdyCoalescedWaiter *waiter in finished) {
+        waiter.request = nil;
+    }
+    [waiters removeAllObjects];
+    self.stream = nil;
+    return finished;
+}
+
+- (void)onConnect:(id<SpdyRequestIdentifier>)identifier {
+    self.stream = identifier;
+    if ([waiters count] == 0) {
+        [identifier close];
+        return;
+    }
+    for (SpdyCoalescedWaiter *waiter in [[waiters copy] autorelease]) {
+        [waiter.delegate onConnect:waiter];
+    }
+}
+
+- (void)onRequestBytesSent:(NSInteger)bytesSend {
+    for (SpdyCoalescedWaiter *waiter in [[waiters copy] autorelease]) {
+        [waiter.delegate onRequestBytesSent:bytesSend];
+    }
+}
+
+- (void)onResponseHeaders:(CFHTTPMessageRef)headers {
+    self.responseStarted = YES;
+    if ([self.table objectForKey:self.key] == self)
+        [self.table removeObjectForKey:self.key];
+    for (SpdyCoalescedWaiter *waiter in [[waiters copy] autorelease]) {
+        [waiter.delegate onResponseHeaders:headers];
+    }
+}
+
+- (size_t)onResponseData:(const uint8_t *)bytes length:(size_t)length {
+    for (SpdyCoalescedWaiter *waiter in [[waiters copy] autorelease]) {
+        [waiter.delegate onResponseData:bytes length:length];
+    }
+    return length;
+}
+
+- (void)onStreamClose {
+    for (SpdyCoalescedWaiter *waiter in [self finish]) {
+        [waiter.delegate onStreamClose];
+    }
+}
+
+- (void)onNotSpdyError:(id<SpdyRequestIdentifier>)identifier {
+    for (SpdyCoalescedWaiter *waiter in [self finish]) {
+        [waiter.delegate onNotSpdyError:waiter];
+    }
+}
+
+- (void)onError:(NSError *)error {
+    for (SpdyCoalescedWaiter *waiter in [self finish]) {
+        [waiter.delegate onError:error];
+    }
+}
+
+@end
@@ -0,0 +1,64 @@
+//
+//  SpdyPushCache.h
+//  A bounded cache of server pushed responses keyed by url.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import <Foundation/Foundation.h>
+#import "SPDY.h"
+
+@class SpdyPushCache;
+@class SpdyStream;
+
+// The delegate of a pushed SpdyStream.  Until a request claims it the response is buffered, afterwards everything
+// is forwarded to the claiming RequestCallback.
+@interface SpdyPushedResponse : RequestCallback<SpdyRequestIdentifier>
+
+// Sends what has been buffered so far to delegate and forwards the rest of the stream to it.
+- (void)attach:(RequestCallback *)delegate;
+
+// Stops the pushed stream without telling a delegate.
+- (void)cancel;
+
+@property (retain) NSURL *url;
+@property (retain) NSURL *associatedUrl;
+@property (retain) SpdyStream *stream;
+@property (readonly) NSUInteger bufferedLength;
+
+@end
+
+@interface SpdyPushCache : NSObject
+
+- (SpdyPushCache *)initWithMaxBytes:(NSUInteger)maxBytes maxEntries:(NSUInteger)maxEntries;
+
+// Returns the response that should receive a stream pushed for url, or nil if the push should be refused.
+- (SpdyPushedResponse *)addPush:(NSURL *)url associatedUrl:(NSURL *)associatedUrl;
+
+// If a response for url was pushed it is removed from the cache and delegate is attached to it on the next run loop
+// iteration.  Returns NO if nothing was pushed for url.
+- (BOOL)claim:(NSURL *)url delegate:(RequestCallback *)delegate;
+
+// Cancels and drops every unclaimed push.
+- (void)removeAll;
+
+// Used by SpdyPushedResponse.
+- (void)push:(SpdyPushedResponse *)push bufferedBytes:(NSUInteger)length;
+- (void)pushFailed:(SpdyPushedResponse *)push;
+
+@property (assign) NSUInteger maxBytes;
+@property (assign) NSUInteger maxEntries;
+@property (readonly) SpdyPushMetrics metrics;
+
+@end
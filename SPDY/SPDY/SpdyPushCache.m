@@ -0,0 +1,240 @@
+//
+//  SpdyPushCache.m
+//  Unclaimed pushes are dropped oldest first once the cache is over maxBytes or maxEntries.  Dropping a push that is
+//  still being received cancels its stream so the server stops sending bytes that will not be used.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyPushCache.h"
+
+#import "SpdyStream.h"
+
+@interface SpdyPushedResponse ()
+@property (assign) SpdyPushCache *cache;
+@property (retain) RequestCallback *delegate;
+@property (assign) CFHTTPMessageRef headers;
+@property (retain) NSMutableData *body;
+@property (retain) NSError *error;
+@property (assign) BOOL complete;
+@end
+
+@implementation SpdyPushedResponse
+
+@synthesize url = _url;
+@synthesize associatedUrl = _associatedUrl;
+@synthesize stream = _stream;
+@synthesize cache = _cache;
+@synthesize delegate = _delegate;
+@synthesize headers = _headers;
+@synthesize body = _body;
+@synthesize error = _error;
+@synthesize complete = _complete;
+
+- (id)init {
+    self = [super init];
+    if (self != nil) {
+        self.body = [NSMutableData data];
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [_url release];
+    [_associatedUrl release];
+    [_stream release];
+    [_delegate release];
+    [_body release];
+    [_error release];
+    if (_headers != NULL)
+        CFRelease(_headers);
+    [super dealloc];
+}
+
+- (NSString *)description {
+    return [NSString stringWithFormat:@"%@: %@ pushed with %@, buffered=%u", [super description], self.url, self.associatedUrl, [self.body length]];
+}
+
+- (NSUInteger)bufferedLength {
+    return [self.body length];
+}
+
+- (void)attach:(RequestCallback *)delegate {
+    self.delegate = delegate;
+    [delegate onConnect:self];
+    if (self.headers != NULL)
+        [delegate onResponseHeaders:self.headers];
+    if ([self.body length] > 0)
+        [delegate onResponseData:[self.body bytes] length:[self.body length]];
+    self.body = nil;
+    if (self.error != nil)
+        [delegate onError:self.error];
+    else if (self.complete)
+        [delegate onStreamClose];
+}
+
+- (void)cancel {
+    self.cache = nil;
+    [self.stream close];
+}
+
+// Closing the identifier handed to the claiming delegate cancels the push if it is still being received.
+- (void)close {
+    [self.stream close];
+}
+
+- (void)onResponseHeaders:(CFHTTPMessageRef)h {
+    if (_headers != NULL)
+        CFRelease(_headers);
+    _headers = CFHTTPMessageCreateCopy(NULL, h);
+    [self.delegate onResponseHeaders:h];
+}
+
+- (size_t)onResponseData:(const uint8_t *)bytes length:(size_t)length {
+    if (self.delegate != nil)
+        return [self.delegate onResponseData:bytes length:length];
+    [self.body appendBytes:bytes length:length];
+    [self.cache push:self bufferedBytes:length];
+    return length;
+}
+
+- (void)onStreamClose {
+    self.complete = YES;
+    self.stream = nil;
+    [self.delegate onStreamClose];
+}
+
+- (void)onError:(NSError *)error {
+    self.error = error;
+    self.stream = nil;
+    [self.cache pushFailed:self];
+    [self.delegate onError:error];
+}
+
+@end
+
+@interface SpdyPushCache ()
+- (void)drop:(SpdyPushedResponse *)push;
+- (void)trim;
+@end
+
+@implementation SpdyPushCache {
+    NSMutableDictionary *pushes;
+    NSMutableArray *pushOrder;
+    SpdyPushMetrics metrics;
+}
+
+@synthesize maxBytes = _maxBytes;
+@synthesize maxEntries = _maxEntries;
+
+- (SpdyPushCache *)initWithMaxBytes:(NSUInteger)maxBytes maxEntries:(NSUInteger)maxEntries {
+    self = [super init];
+    if (self != nil) {
+        self.maxBytes = maxBytes;
+        self.maxEntries = maxEntries;
+        pushes = [[NSMutableDictionary alloc] init];
+        pushOrder = [[NSMutableArray alloc] init];
+        memset(&metrics, 0, sizeof(metrics));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    [self removeAll];
+    [pushes release];
+    [pushOrder release];
+    [super dealloc];
+}
+
+- (SpdyPushMetrics)metrics {
+    return metrics;
+}
+
+- (SpdyPushedResponse *)addPush:(NSURL *)url associatedUrl:(NSURL *)associatedUrl {
+    if (self.maxEntries == 0)
+        return nil;
+    SpdyPushedResponse *old = [pushes objectForKey:[url absoluteString]];
+    if (old != nil) {
+        SPDY_LOG(@"Replacing %@", old);
+        [[old retain] autorelease];
+        [self drop:old];
+        [old cancel];
+    }
+    SpdyPushedResponse *push = [[[SpdyPushedResponse alloc] init] autorelease];
+    push.url = url;
+    push.associatedUrl = associatedUrl;
+    push.cache = self;
+    [pushes setObject:push forKey:[url absoluteString]];
+    [pushOrder addObject:push];
+    metrics.pushedStreams++;
+    [self trim];
+    return push;
+}
+
+- (BOOL)claim:(NSURL *)url delegate:(RequestCallback *)delegate {
+    SpdyPushedResponse *push = [pushes objectForKey:[url absoluteString]];
+    if (push == nil)
+        return NO;
+    SPDY_LOG(@"Using %@ for %@", push, url);
+    [[push retain] autorelease];
+    [pushes removeObjectForKey:[url absoluteString]];
+    [pushOrder removeObjectIdenticalTo:push];
+    metrics.bufferedBytes -= push.bufferedLength;
+    metrics.claimedStreams++;
+    push.cache = nil;
+    // Sessions are scheduled in the common modes, so claimed pushes are delivered in the same modes, e.g. while scrolling.
+    [push performSelector:@selector(attach:) withObject:delegate afterDelay:0 inModes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+    return YES;
+}
+
+- (void)removeAll {
+    while ([pushOrder count] > 0) {
+        SpdyPushedResponse *push = [[[pushOrder objectAtIndex:0] retain] autorelease];
+        [self drop:push];
+        [push cancel];
+    }
+}
+
+- (void)push:(SpdyPushedResponse *)push bufferedBytes:(NSUInteger)length {
+    metrics.bufferedBytes += length;
+    [self trim];
+}
+
+- (void)pushFailed:(SpdyPushedResponse *)push {
+    [[push retain] autorelease];
+    [self drop:push];
+}
+
+- (void)drop:(SpdyPushedResponse *)push {
+    if ([pushOrder indexOfObjectIdenticalTo:push] == NSNotFound)
+        return;
+    metrics.bufferedBytes -= push.bufferedLength;
+    metrics.unusedBytes += push.bufferedLength;
+    metrics.droppedStreams++;
+    push.cache = nil;
+    [pushOrder removeObjectIdenticalTo:push];
+    if ([pushes objectForKey:[push.url absoluteString]] == push)
+        [pushes removeObjectForKey:[push.url absoluteString]];
+}
+
+- (void)trim {
+    while ([pushOrder count] > 0 && (metrics.bufferedBytes > self.maxBytes || [pushOrder count] > self.maxEntries)) {
+        SpdyPushedResponse *oldest = [[[pushOrder objectAtIndex:0] retain] autorelease];
+        SPDY_LOG(@"Push cache is full, dropping %@", oldest);
+        [self drop:oldest];
+        [oldest cancel];
+    }
+}
+
+@end
@@ -0,0 +1,36 @@
+//
+//  SpdyReplaySession.h
+//  A SpdySession that replays a capture written by -[SpdySession captureToFile:] without a socket or SSL.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdySession.h"
+
+// Requests have to be fetched in the same order as in the captured session so that the stream ids match the
+// captured frames.  Everything spdylay sends is discarded.
+@interface SpdyReplaySession : SpdySession
+
+// Returns nil if the capture does not start with a valid capture header.
+- (SpdyReplaySession *)initWithCapture:(NSData *)capture;
++ (SpdyReplaySession *)newFromCaptureFile:(NSString *)path;
+
+// Submits the fetched requests and feeds the whole capture through spdylay as fast as possible.  Returns 0 once the
+// capture has been consumed or the spdylay error that stopped the replay.
+- (int)replay;
+
+@property (readonly, assign) NSUInteger bytesReplayed;
+@property (readonly, assign) NSUInteger bytesSent;
+
+@end
@@ -0,0 +1,104 @@
+//
+//  SpdyReplaySession.m
+//  The replay transport just copies from the capture in recv_data and drops everything in send_data.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyReplaySession.h"
+
+#import "SPDY.h"
+
+#include "spdylay/spdylay.h"
+
+static const NSUInteger kCaptureHeaderLength = sizeof(kSpdyCaptureMagic) + 2;
+
+@interface SpdyReplaySession ()
+@property (readwrite, assign) NSUInteger bytesReplayed;
+@property (readwrite, assign) NSUInteger bytesSent;
+@property (retain) NSData *capture;
+@end
+
+@implementation SpdyReplaySession
+
+@synthesize bytesReplayed = _bytesReplayed;
+@synthesize bytesSent = _bytesSent;
+@synthesize capture = _capture;
+
+- (SpdyReplaySession *)initWithCapture:(NSData *)capture {
+    self = [super init:NULL oldSession:NULL];
+    if (self == nil)
+        return nil;
+    const uint8_t *bytes = [capture bytes];
+    if ([capture length] < kCaptureHeaderLength || memcmp(bytes, kSpdyCaptureMagic, sizeof(kSpdyCaptureMagic)) != 0) {
+        SPDY_LOG(@"Not a spdy capture, length %u", [capture length]);
+        [self release];
+        return nil;
+    }
+    self.spdyVersion = (bytes[sizeof(kSpdyCaptureMagic)] << 8) | bytes[sizeof(kSpdyCaptureMagic) + 1];
+    self.spdyNegotiated = YES;
+    self.capture = capture;
+    self.bytesReplayed = kCaptureHeaderLength;
+    self.bytesSent = 0;
+    return self;
+}
+
++ (SpdyReplaySession *)newFromCaptureFile:(NSString *)path {
+    NSData *capture = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedIfSafe error:nil];
+    if (capture == nil)
+        return nil;
+    return [[SpdyReplaySession alloc] initWithCapture:capture];
+}
+
+- (void)dealloc {
+    [_capture release];
+    [super dealloc];
+}
+
+- (int)replay {
+    self.connectState = CONNECTED;
+    [self startSpdySession];
+    while (self.bytesReplayed < [self.capture length]) {
+        spdylay_session_send(self.session);
+        int r = spdylay_session_recv(self.session);
+        if (r != 0 && r != SPDYLAY_ERR_EOF) {
+            SPDY_LOG(@"Replay stopped after %u bytes: %d", self.bytesReplayed, r);
+            return r;
+        }
+    }
+    spdylay_session_send(self.session);
+    return 0;
+}
+
+- (int)recv_data:(uint8_t *)data len:(size_t)len flags:(int)flags {
+    NSUInteger remaining = [self.capture length] - self.bytesReplayed;
+    if (len > remaining)
+        len = remaining;
+    memcpy(data, (const uint8_t *)[self.capture bytes] + self.bytesReplayed, len);
+    self.bytesReplayed += len;
+    return (int)len;
+}
+
+- (int)send_data:(const uint8_t *)data len:(size_t)len flags:(int)flags {
+    self.bytesSent += len;
+    return (int)len;
+}
+
+- (ssize_t)fixUpCallbackValue:(int)r {
+    if (r > 0)
+        return r;
+    return SPDYLAY_ERR_EOF;
+}
+
+@end
@@ -21,6 +21,7 @@
 #include "openssl/ssl.h"
 
 @class RequestCallback;
+@class SpdyPushCache;
 @class SpdyStream;
 
 struct spdylay_session;
@@ -39,6 +40,10 @@ typedef enum {
     kSpdyReachableViaWiFi	
 } SpdyNetworkStatus;
 
+// A capture starts with kSpdyCaptureMagic followed by the negotiated spdy version as a big endian uint16.  The rest of
+// the file is the decrypted byte stream read from the server.
+extern const char kSpdyCaptureMagic[4];
+
 @interface SpdySession : NSObject {
     struct spdylay_session *session;
     
@@ -54,10 +59,29 @@ typedef enum {
 @property (assign) enum ConnectState connectState;
 @property (assign) SpdyNetworkStatus networkStatus;
 
+// Sends a PING as soon as spdy is negotiated to warm up the connection.
+@property (assign) BOOL warmUpWithPing;
+
+// Sends a PING now if spdy has been negotiated, otherwise sets warmUpWithPing.
+- (void)warmUp;
+
+// The number of streams ever added to the session.
+@property (readonly, assign) NSUInteger streamCount;
+
+// Streams pushed by the server are refused unless there is a push cache to put them in.
+@property (retain) SpdyPushCache *pushCache;
+// Returns YES if a push of url would be put in pushCache, which requires the scheme, host and port of the session.
+- (BOOL)canAcceptPush:(NSURL *)url;
+
+// The ip:port the session connects to.
+@property (retain) NSString *peerAddress;
+
 - (SpdySession *)init:(SSL_CTX *)ssl_ctx oldSession:(SSL_SESSION *)oldSession;
 
 // Returns nil if the session is able to start a connection to host.
 - (NSError *)connect:(NSURL *)host;
+// Like connect: above, but with an address already resolved by addressForUrl:error:.
+- (NSError *)connect:(NSURL *)host address:(NSData *)address;
 - (void)fetch:(NSURL *)path delegate:(RequestCallback *)delegate;
 - (void)fetchFromMessage:(CFHTTPMessageRef)request delegate:(RequestCallback *)delegate body:(NSInputStream *)body;
 - (void)fetchFromRequest:(NSURLRequest *)request delegate:(RequestCallback *)delegate;
@@ -66,11 +90,37 @@ typedef enum {
 - (NSInteger)resetStreamsAndGoAway;
 - (SSL_SESSION *)getSslSession;
 
+// Writes every decrypted byte read from the server to path so that the session can be replayed later by a
+// SpdyReplaySession.  Must be called before the session connects.  Returns NO if path could not be opened.
+- (BOOL)captureToFile:(NSString *)path;
+
 
 // Indicates if the session has entered an invalid state.
 - (BOOL)isInvalid;
 
+// Returns YES if the server certificate is valid for hostname.  The subjectAltName dns names are used, or the common
+// name if there are none.  An ipv4 address hostname is matched against the subjectAltName ip addresses.
+- (BOOL)certificateMatchesHost:(NSString *)hostname;
++ (BOOL)certificateName:(NSString *)name matchesHost:(NSString *)hostname;
++ (BOOL)certificateAddress:(NSData *)address matchesHost:(NSString *)hostname;
+
+// Resolves the sockaddr that a session for url would connect to, or returns nil and sets error.
++ (NSData *)addressForUrl:(NSURL *)url error:(NSError **)error;
+// Picks the address a session for url would connect to from the sockaddrs resolved by a CFHost, or returns nil.
++ (NSData *)addressForUrl:(NSURL *)url fromHostAddresses:(NSArray *)addresses;
+// Returns address as ip:port, the format of peerAddress.
++ (NSString *)stringForAddress:(NSData *)address;
+
 // Used by the SpdyStream
 - (void)cancelStream:(SpdyStream *)stream;
 
+// The transport used by the spdylay callbacks.  The default implementation reads and writes through SSL, subclasses
+// may override these to feed spdylay from another source.
+- (int)recv_data:(uint8_t *)data len:(size_t)len flags:(int)flags;
+- (int)send_data:(const uint8_t *)data len:(size_t)len flags:(int)flags;
+- (ssize_t)fixUpCallbackValue:(int)r;
+
+// Creates the spdylay session once spdy has been negotiated and submits any post-poned streams.
+- (void)startSpdySession;
+
 @end
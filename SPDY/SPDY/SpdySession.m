@@ -36,42 +36,51 @@
 
 
 #import "SPDY.h"
+#import "SpdyPushCache.h"
 #import "SpdyStream.h"
 
 #include "openssl/ssl.h"
 #include "openssl/err.h"
+#include "openssl/x509v3.h"
 #include "spdylay/spdylay.h"
 
 static const int priority = 1;
+const char kSpdyCaptureMagic[4] = {'S', 'P', 'C', 'P'};
 
 @interface SpdySession ()
 
 @property (retain, nonatomic) NSDate *lastCallbackTime;
+@property (readwrite, assign) NSUInteger streamCount;
+@property (retain, nonatomic) NSDate *pingTime;
 
 - (void)_cancelStream:(SpdyStream *)stream;
 - (NSError *)connectTo:(NSURL *)url;
+- (NSError *)connectToAddress:(NSData *)address;
 - (void)connectionFailed:(NSInteger)error domain:(NSString *)domain;
 - (void)invalidateSocket;
 - (void)removeStream:(SpdyStream *)stream;
-- (int)send_data:(const uint8_t *)data len:(size_t)len flags:(int)flags;
+- (SpdyStream *)streamForId:(int32_t)streamId;
+- (void)addPushedStream:(spdylay_syn_stream *)syn;
+- (void)captureBytes:(const uint8_t *)data len:(size_t)len;
 - (BOOL)sslConnect;
 - (BOOL)sslHandshake;  // Returns true if the handshake completed.
 - (void)sslError;
 - (BOOL)submitRequest:(SpdyStream *)stream;
 - (BOOL)wouldBlock:(int)r;
-- (ssize_t)fixUpCallbackValue:(int)r;
 - (void)enableWriteCallback;
 @end
 
 
 @implementation SpdySession {
     NSMutableSet *streams;
+    NSMutableDictionary *pushedStreams;  // Pushed streams have no spdylay stream user data.
     
     CFSocketRef socket;
     SSL *ssl;
     SSL_CTX *ssl_ctx;
     SSL_SESSION *oldSslSession;
     spdylay_session_callbacks *callbacks;
+    NSOutputStream *captureStream;
 }
 
 @synthesize spdyNegotiated;
@@ -80,6 +89,11 @@ static const int priority = 1;
 @synthesize host;
 @synthesize connectState;
 @synthesize networkStatus;
+@synthesize warmUpWithPing = _warmUpWithPing;
+@synthesize streamCount = _streamCount;
+@synthesize pingTime = _pingTime;
+@synthesize pushCache = _pushCache;
+@synthesize peerAddress = _peerAddress;
 
 static void sessionCallBack(CFSocketRef s,
                             CFSocketCallBackType callbackType,
@@ -126,7 +140,7 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
     return bytesRead;
 }
 
-- (NSError *)connectTo:(NSURL *)url {
+static int lookup_host(NSURL *url, struct addrinfo **res) {
     struct addrinfo hints;
     
     char service[10];
@@ -140,41 +154,79 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
     hints.ai_family = AF_INET;
     hints.ai_socktype = SOCK_STREAM;
     
-    struct addrinfo *res;
     SPDY_LOG(@"Looking up hostname for %@", [url host]);
-    int err = getaddrinfo([[url host] UTF8String], service, &hints, &res);
+    return getaddrinfo([[url host] UTF8String], service, &hints, res);
+}
+
+static NSString *address_string(const struct sockaddr *addr) {
+    const struct sockaddr_in *addr_in = (const struct sockaddr_in *)addr;
+    char ip[INET_ADDRSTRLEN];
+    if (inet_ntop(AF_INET, &addr_in->sin_addr, ip, sizeof(ip)) == NULL)
+        return nil;
+    return [NSString stringWithFormat:@"%s:%u", ip, ntohs(addr_in->sin_port)];
+}
+
++ (NSData *)addressForUrl:(NSURL *)url error:(NSError **)error {
+    struct addrinfo *res;
+    int err = lookup_host(url, &res);
     if (err != 0) {
-        NSError *error;
         if (err == EAI_SYSTEM) {
-            error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+            *error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
         } else {
-            error = [NSError errorWithDomain:@"kCFStreamErrorDomainNetDB" code:err userInfo:nil];
+            *error = [NSError errorWithDomain:@"kCFStreamErrorDomainNetDB" code:err userInfo:nil];
         }
-        SPDY_LOG(@"Error getting IP address for %@ (%@)", url, error);
+        SPDY_LOG(@"Error getting IP address for %@ (%@)", url, *error);
+        return nil;
+    }
+    if (res == NULL) {
+        *error = [NSError errorWithDomain:(NSString *)kCFErrorDomainCFNetwork code:kCFHostErrorHostNotFound userInfo:nil];
+        return nil;
+    }
+    NSData *address = [NSData dataWithBytes:res->ai_addr length:res->ai_addrlen];
+    freeaddrinfo(res);
+    return address;
+}
+
++ (NSData *)addressForUrl:(NSURL *)url fromHostAddresses:(NSArray *)addresses {
+    for (NSData *address in addresses) {
+        if ([address length] < sizeof(struct sockaddr_in) || ((const struct sockaddr *)[address bytes])->sa_family != AF_INET)
+            continue;
+        struct sockaddr_in addr;
+        memcpy(&addr, [address bytes], sizeof(addr));
+        addr.sin_port = htons([url port] != nil ? [[url port] intValue] : 443);
+        return [NSData dataWithBytes:&addr length:sizeof(addr)];
+    }
+    return nil;
+}
+
++ (NSString *)stringForAddress:(NSData *)address {
+    return address_string((const struct sockaddr *)[address bytes]);
+}
+
+- (NSError *)connectTo:(NSURL *)url {
+    NSError *error = nil;
+    NSData *address = [SpdySession addressForUrl:url error:&error];
+    if (address == nil) {
         self.connectState = ERROR;
         return error;
     }
+    return [self connectToAddress:address];
+}
 
-    struct addrinfo* rp = res;
-    if (rp != NULL) {
-        CFSocketContext ctx = {0, self, NULL, NULL, NULL};
-        CFDataRef address = CFDataCreate(NULL, (const uint8_t*)rp->ai_addr, rp->ai_addrlen);
-        socket = CFSocketCreate(NULL, PF_INET, SOCK_STREAM, IPPROTO_TCP, kCFSocketConnectCallBack | kCFSocketReadCallBack | kCFSocketWriteCallBack,
-                                &sessionCallBack, &ctx);
-        CFSocketConnectToAddress(socket, address, -1);
-        
-        // Ignore write failures, and deal with then on write.
-        int set = 1;
-        int sock = CFSocketGetNative(socket);
-        setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
-        
-        CFRelease(address);
-        self.connectState = CONNECTING;
-        freeaddrinfo(res);
-        return nil;
-    }
-    self.connectState = ERROR;
-    return [NSError errorWithDomain:(NSString *)kCFErrorDomainCFNetwork code:kCFHostErrorHostNotFound userInfo:nil];
+- (NSError *)connectToAddress:(NSData *)address {
+    self.peerAddress = [SpdySession stringForAddress:address];
+    CFSocketContext ctx = {0, self, NULL, NULL, NULL};
+    socket = CFSocketCreate(NULL, PF_INET, SOCK_STREAM, IPPROTO_TCP, kCFSocketConnectCallBack | kCFSocketReadCallBack | kCFSocketWriteCallBack,
+                            &sessionCallBack, &ctx);
+    CFSocketConnectToAddress(socket, (CFDataRef)address, -1);
+    
+    // Ignore write failures, and deal with then on write.
+    int set = 1;
+    int sock = CFSocketGetNative(socket);
+    setsockopt(sock, SOL_SOCKET, SO_NOSIGPIPE, (void *)&set, sizeof(int));
+    
+    self.connectState = CONNECTING;
+    return nil;
 }
 
 - (void)notSpdyError {
@@ -209,7 +261,7 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
 }
 
 - (NSInteger)resetStreamsAndGoAway {
-    NSInteger cancelledStreams = [streams count];
+    NSInteger cancelledStreams = [streams count] - [pushedStreams count];
     for (SpdyStream *stream in streams) {
         [self _cancelStream:stream];
     }
@@ -230,6 +282,69 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
     return socket == nil;
 }
 
++ (BOOL)certificateName:(NSString *)name matchesHost:(NSString *)hostname {
+    name = [name lowercaseString];
+    hostname = [hostname lowercaseString];
+    if (![name hasPrefix:@"*."])
+        return [name isEqualToString:hostname];
+
+    // A wildcard only stands for the whole left most label.
+    NSRange firstDot = [hostname rangeOfString:@"."];
+    if (firstDot.location == NSNotFound || firstDot.location == 0)
+        return NO;
+    return [[hostname substringFromIndex:firstDot.location] isEqualToString:[name substringFromIndex:1]];
+}
+
++ (BOOL)certificateAddress:(NSData *)address matchesHost:(NSString *)hostname {
+    struct in_addr addr;
+    if (inet_pton(AF_INET, [hostname UTF8String], &addr) != 1)
+        return NO;
+    return [address length] == sizeof(addr) && memcmp([address bytes], &addr, sizeof(addr)) == 0;
+}
+
+- (BOOL)certificateMatchesHost:(NSString *)hostname {
+    if (ssl == NULL)
+        return NO;
+    X509 *cert = SSL_get_peer_certificate(ssl);
+    if (cert == NULL)
+        return NO;
+
+    // An ip address only matches ip address entries, never dns names or the common name.
+    struct in_addr addr;
+    BOOL isAddress = inet_pton(AF_INET, [hostname UTF8String], &addr) == 1;
+    BOOL matches = NO;
+    BOOL hasDnsName = NO;
+    GENERAL_NAMES *altNames = X509_get_ext_d2i(cert, NID_subject_alt_name, NULL, NULL);
+    for (int i = 0; i < sk_GENERAL_NAME_num(altNames) && !matches; ++i) {
+        GENERAL_NAME *altName = sk_GENERAL_NAME_value(altNames, i);
+        if (altName->type == GEN_IPADD) {
+            NSData *address = [NSData dataWithBytes:ASN1_STRING_data(altName->d.iPAddress)
+                                             length:ASN1_STRING_length(altName->d.iPAddress)];
+            matches = [SpdySession certificateAddress:address matchesHost:hostname];
+            continue;
+        }
+        if (altName->type != GEN_DNS)
+            continue;
+        hasDnsName = YES;
+        if (isAddress)
+            continue;
+        NSString *name = [[[NSString alloc] initWithBytes:ASN1_STRING_data(altName->d.dNSName)
+                                                   length:ASN1_STRING_length(altName->d.dNSName)
+                                                 encoding:NSASCIIStringEncoding] autorelease];
+        matches = [SpdySession certificateName:name matchesHost:hostname];
+    }
+    GENERAL_NAMES_free(altNames);
+
+    // The common name is only used when there are no dns names.
+    if (!hasDnsName && !isAddress) {
+        char commonName[256];
+        if (X509_NAME_get_text_by_NID(X509_get_subject_name(cert), NID_commonName, commonName, sizeof(commonName)) > 0)
+            matches = [SpdySession certificateName:[NSString stringWithUTF8String:commonName] matchesHost:hostname];
+    }
+    X509_free(cert);
+    return matches;
+}
+
 - (BOOL)submitRequest:(SpdyStream *)stream {
     if (!self.spdyNegotiated) {
         [stream notSpdyError];
@@ -260,16 +375,7 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
             return NO;
         }
 
-        spdylay_session_client_new(&session, self.spdyVersion, callbacks, self);
-
-        NSEnumerator *enumerator = [streams objectEnumerator];
-        id stream;
-        
-        while ((stream = [enumerator nextObject])) {
-            if (![self submitRequest:stream]) {
-                [streams removeObject:stream];
-            }
-        }
+        [self startSpdySession];
         SPDY_LOG(@"Reused session: %ld", SSL_session_reused(ssl));
         return YES;
     }
@@ -286,6 +392,72 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
     return NO;
 }
 
+- (void)startSpdySession {
+    spdylay_session_client_new(&session, self.spdyVersion, callbacks, self);
+    if (captureStream != nil) {
+        uint8_t header[sizeof(kSpdyCaptureMagic) + 2];
+        memcpy(header, kSpdyCaptureMagic, sizeof(kSpdyCaptureMagic));
+        header[sizeof(kSpdyCaptureMagic)] = (self.spdyVersion >> 8) & 0xff;
+        header[sizeof(kSpdyCaptureMagic) + 1] = self.spdyVersion & 0xff;
+        [self captureBytes:header len:sizeof(header)];
+    }
+    if (self.warmUpWithPing) {
+        self.pingTime = [NSDate date];
+        spdylay_submit_ping(session);
+    }
+
+    NSEnumerator *enumerator = [streams objectEnumerator];
+    id stream;
+    
+    while ((stream = [enumerator nextObject])) {
+        if (![self submitRequest:stream]) {
+            [streams removeObject:stream];
+        }
+    }
+}
+
+- (void)warmUp {
+    if (session == NULL) {
+        self.warmUpWithPing = YES;
+        return;
+    }
+    self.pingTime = [NSDate date];
+    spdylay_submit_ping(session);
+    int err = spdylay_session_send(session);
+    if (err != 0) {
+        SPDY_LOG(@"Error (%d) sending PING for %@", err, self);
+    }
+}
+
+- (BOOL)captureToFile:(NSString *)path {
+    [captureStream close];
+    [captureStream release];
+    captureStream = [[NSOutputStream alloc] initToFileAtPath:path append:NO];
+    [captureStream open];
+    if ([captureStream streamStatus] != NSStreamStatusOpen) {
+        SPDY_LOG(@"Could not open capture file %@: %@", path, [captureStream streamError]);
+        [captureStream release];
+        captureStream = nil;
+        return NO;
+    }
+    return YES;
+}
+
+- (void)captureBytes:(const uint8_t *)data len:(size_t)len {
+    while (len > 0) {
+        NSInteger written = [captureStream write:data maxLength:len];
+        if (written <= 0) {
+            SPDY_LOG(@"Stopping capture for %@ because of %@", self, [captureStream streamError]);
+            [captureStream close];
+            [captureStream release];
+            captureStream = nil;
+            return;
+        }
+        data += written;
+        len -= written;
+    }
+}
+
 - (void)setUpSSL {
     // Create SSL context.
     int sock = CFSocketGetNative(socket);
@@ -320,9 +492,15 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
     return [self connectTo:h];
 }
 
+- (NSError *)connect:(NSURL *)h address:(NSData *)address {
+    self.host = h;
+    return [self connectToAddress:address];
+}
+
 - (void)addStream:(SpdyStream *)stream {
     stream.parentSession = self;
     [streams addObject:stream];
+    self.streamCount += 1;
     if (self.connectState == CONNECTED) {
         if (![self submitRequest:stream]) {
             return;
@@ -358,7 +536,10 @@ static ssize_t read_from_data_callback(spdylay_session *session, int32_t stream_
 }
 
 - (int)recv_data:(uint8_t *)data len:(size_t)len flags:(int)flags {
-    return SSL_read(ssl, data, (int)len);
+    int r = SSL_read(ssl, data, (int)len);
+    if (r > 0 && captureStream != nil)
+        [self captureBytes:data len:r];
+    return r;
 }
 
 - (BOOL)wouldBlock:(int)sslError {
@@ -417,17 +598,40 @@ static ssize_t send_callback(spdylay_session *session, const uint8_t *data, size
     return [ss fixUpCallbackValue:r];
 }
 
+static int effective_port(NSURL *url) {
+    if ([url port] != nil)
+        return [[url port] intValue];
+    return [[url scheme] caseInsensitiveCompare:@"http"] == NSOrderedSame ? 80 : 443;
+}
+
+static BOOL same_origin(NSURL *a, NSURL *b) {
+    if ([a scheme] == nil || [a host] == nil)
+        return NO;
+    return [[a scheme] caseInsensitiveCompare:[b scheme]] == NSOrderedSame &&
+        [[a host] caseInsensitiveCompare:[b host]] == NSOrderedSame &&
+        effective_port(a) == effective_port(b);
+}
+
+static BOOL has_status(char **nv) {
+    for (; nv[0] != NULL && nv[1] != NULL; nv += 2) {
+        if (strcmp(nv[0], ":status") == 0)
+            return YES;
+    }
+    return NO;
+}
+
 static void on_data_chunk_recv_callback(spdylay_session *session, uint8_t flags, int32_t stream_id,
                                         const uint8_t *data, size_t len, void *user_data) {
-    SpdyStream *stream = spdylay_session_get_stream_user_data(session, stream_id);
+    SpdySession *ss = (SpdySession *)user_data;
+    SpdyStream *stream = [ss streamForId:stream_id];
     [stream writeBytes:data len:len];
 }
 
 static void on_stream_close_callback(spdylay_session *session, int32_t stream_id, spdylay_status_code status_code, void *user_data) {
-    SpdyStream *stream = spdylay_session_get_stream_user_data(session, stream_id);
+    SpdySession *ss = (SpdySession *)user_data;
+    SpdyStream *stream = [ss streamForId:stream_id];
     SPDY_LOG(@"Stream closed %@, because spdylay_status_code=%d", stream, status_code);
     [stream closeStream];
-    SpdySession *ss = (SpdySession *)user_data;
     [ss removeStream:stream];
 }
 
@@ -437,6 +641,23 @@ static void on_ctrl_recv_callback(spdylay_session *session, spdylay_frame_type t
         SpdyStream *stream = spdylay_session_get_stream_user_data(session, reply->stream_id);
         SPDY_LOG(@"Received headers for %@", stream)
         [stream parseHeaders:(const char **)reply->nv];
+    } else if (type == SPDYLAY_SYN_STREAM) {
+        SpdySession *ss = (SpdySession *)user_data;
+        [ss addPushedStream:&frame->syn_stream];
+    } else if (type == SPDYLAY_HEADERS) {
+        // A pushed stream may send its status in a HEADERS frame after the SYN_STREAM.
+        spdylay_headers *headers = &frame->headers;
+        SpdySession *ss = (SpdySession *)user_data;
+        SpdyStream *stream = [ss streamForId:headers->stream_id];
+        if (stream.associatedStreamId > 0 && has_status(headers->nv))
+            [stream parseHeaders:(const char **)headers->nv];
+    } else if (type == SPDYLAY_PING) {
+        // Client initiated PINGs have odd ids, even ids are the server's own PINGs that spdylay answers.
+        SpdySession *ss = (SpdySession *)user_data;
+        if ((frame->ping.unique_id & 1) == 1 && ss.pingTime != nil) {
+            SPDY_LOG(@"PING reply for %@ after %fs", ss, -[ss.pingTime timeIntervalSinceNow]);
+            ss.pingTime = nil;
+        }
     }
 }
 
@@ -451,9 +672,47 @@ static void before_ctrl_send_callback(spdylay_session *session, spdylay_frame_ty
 }
 
 - (void)removeStream:(SpdyStream *)stream {
+    if (stream.associatedStreamId > 0)
+        [pushedStreams removeObjectForKey:[NSNumber numberWithInteger:stream.streamId]];
     [streams removeObject:stream];
 }
 
+- (SpdyStream *)streamForId:(int32_t)streamId {
+    SpdyStream *stream = spdylay_session_get_stream_user_data(session, streamId);
+    if (stream == nil)
+        stream = [pushedStreams objectForKey:[NSNumber numberWithInt:streamId]];
+    return stream;
+}
+
+- (BOOL)canAcceptPush:(NSURL *)url {
+    // Only accept pushes for the origin (scheme, host and port) of this session.
+    return self.pushCache != nil && same_origin(url, self.host);
+}
+
+- (void)addPushedStream:(spdylay_syn_stream *)syn {
+    SpdyStream *parent = spdylay_session_get_stream_user_data(session, syn->assoc_stream_id);
+    NSURL *url = [SpdyStream urlFromPushHeaders:(const char **)syn->nv];
+    SpdyPushedResponse *push = nil;
+    if (parent != nil && url != nil && [self canAcceptPush:url])
+        push = [self.pushCache addPush:url associatedUrl:[parent url]];
+    if (push == nil) {
+        SPDY_LOG(@"Refusing pushed stream %d for %@ with %@", syn->stream_id, url, parent);
+        spdylay_submit_rst_stream(session, syn->stream_id, SPDYLAY_REFUSED_STREAM);
+        return;
+    }
+
+    SpdyStream *stream = [[SpdyStream newFromPushedUrl:url delegate:push] autorelease];
+    stream.streamId = syn->stream_id;
+    stream.associatedStreamId = syn->assoc_stream_id;
+    stream.parentSession = self;
+    push.stream = stream;
+    [streams addObject:stream];
+    [pushedStreams setObject:stream forKey:[NSNumber numberWithInt:syn->stream_id]];
+    SPDY_LOG(@"Accepted pushed stream %@ associated with %@", stream, parent);
+    if (has_status(syn->nv))
+        [stream parseHeaders:(const char **)syn->nv];
+}
+
 - (SpdySession *)init:(SSL_CTX *)ssl_context oldSession:(SSL_SESSION *)oldSession {
     self = [super init];
     ssl_ctx = ssl_context;
@@ -474,6 +733,7 @@ static void before_ctrl_send_callback(spdylay_session *session, spdylay_frame_ty
     self.connectState = NOT_CONNECTED;
     
     streams = [[NSMutableSet alloc] init];
+    pushedStreams = [[NSMutableDictionary alloc] init];
     
     return self;
 }
@@ -485,6 +745,12 @@ static void before_ctrl_send_callback(spdylay_session *session, spdylay_frame_ty
         session = NULL;
     }
     [streams release];
+    [pushedStreams release];
+    [_pingTime release];
+    [_pushCache release];
+    [_peerAddress release];
+    [captureStream close];
+    [captureStream release];
     if (ssl != NULL) {
         SSL_shutdown(ssl);
         SSL_free(ssl);
@@ -47,6 +47,10 @@
 + (SpdyStream *)newFromCFHTTPMessage:(CFHTTPMessageRef)msg delegate:(RequestCallback *)delegate body:(NSInputStream *)body;
 + (SpdyStream *)newFromNSURL:(NSURL *)url delegate:(RequestCallback *)delegate;
 + (SpdyStream *)newFromRequest:(NSURLRequest *)request delegate:(RequestCallback *)delegate;
++ (SpdyStream *)newFromPushedUrl:(NSURL *)url delegate:(RequestCallback *)delegate;
+
+// Returns the url of a server pushed stream from its SYN_STREAM headers or nil if the headers do not contain a url.
++ (NSURL *)urlFromPushHeaders:(const char **)nameValuePairs;
 
 + (void)staticInit;
 
@@ -56,6 +60,9 @@
 @property (assign, nonatomic) NSInteger streamId;
 @property (retain, nonatomic) SpdySession *parentSession;
 
+// The stream a server pushed stream was pushed with, 0 for streams started by the client.
+@property (assign, nonatomic) NSInteger associatedStreamId;
+
 // If a stream is closed after the timeout the session should probably be closed.
 @property (assign, nonatomic) NSTimeInterval streamTimeoutInterval;
 
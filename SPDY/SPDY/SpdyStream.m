@@ -48,6 +48,7 @@ NSString *kSpdyTimeoutHeader = @"x-spdy-timeout";
 @synthesize delegate;
 @synthesize parentSession;
 @synthesize streamId;
+@synthesize associatedStreamId;
 @synthesize stringArena;
 
 + (void)staticInit {
@@ -311,4 +312,31 @@ NSString *kSpdyTimeoutHeader = @"x-spdy-timeout";
     return stream;
 }
 
++ (SpdyStream *)newFromPushedUrl:(NSURL *)url delegate:(RequestCallback *)delegate {
+    SpdyStream *stream = [[SpdyStream alloc] init];
+    stream.url = url;
+    stream.delegate = delegate;
+    return stream;
+}
+
++ (NSURL *)urlFromPushHeaders:(const char **)nameValuePairs {
+    const char *scheme = NULL;
+    const char *host = NULL;
+    const char *path = NULL;
+    while (*nameValuePairs != NULL && *(nameValuePairs + 1) != NULL) {
+        if (strcmp(nameValuePairs[0], ":scheme") == 0)
+            scheme = nameValuePairs[1];
+        else if (strcmp(nameValuePairs[0], ":host") == 0)
+            host = nameValuePairs[1];
+        else if (strcmp(nameValuePairs[0], ":path") == 0)
+            path = nameValuePairs[1];
+        else if (strcmp(nameValuePairs[0], "url") == 0)  // spdy/2
+            return [NSURL URLWithString:[NSString stringWithUTF8String:nameValuePairs[1]]];
+        nameValuePairs += 2;
+    }
+    if (scheme == NULL || host == NULL || path == NULL)
+        return nil;
+    return [NSURL URLWithString:[NSString stringWithFormat:@"%s://%s%s", scheme, host, path]];
+}
+
 @end
@@ -19,6 +19,8 @@
 
 #import "EndToEndTests.h"
 #import "SPDY.h"
+#import "SpdySession.h"
+#import "SpdySessionKey.h"
 #import "SpdyUrlConnection.h"
 
 #include <netdb.h>
@@ -141,6 +143,10 @@ static const int port = 9783;
 }
 @end
 
+@interface SPDY (EndToEndTests)
+@property (nonatomic, retain) NSMutableDictionary *sessions;
+@end
+
 @interface EndToEndTests ()
 @property (retain) E2ECallback *delegate;
 @property (assign) BOOL exitNeeded;
@@ -165,6 +171,9 @@ static const int port = 9783;
 - (void)tearDown {
     self.delegate = nil;
     [SpdyUrlConnection unregister];
+    // Options turned on by a test are reset here so that a failed test does not leave them on.
+    [SPDY sharedSPDY].coalesceRequests = NO;
+    [SPDY sharedSPDY].coalesceOrigins = NO;
 }
 
 // All code under test must be linked into the Unit Test bundle
@@ -519,6 +528,101 @@ static void CloseReadStreamClientCallBack(CFReadStreamRef readStream, CFStreamEv
     [delegate release];
 }
 
+// Runs the run loop until condition is true or timeout seconds have passed.
+static BOOL RunLoopUntil(BOOL (^condition)(void), NSTimeInterval timeout) {
+    NSDate *deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while (!condition() && [deadline timeIntervalSinceNow] > 0) {
+        CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0.01, false);
+    }
+    return condition();
+}
+
+- (void)testPreconnect {
+    SPDY *spdy = [SPDY sharedSPDY];
+    NSURL *url = [NSURL URLWithString:@"https://localhost:9793/"];
+    [spdy closeAllSessions];
+
+    NSDate *start = [NSDate date];
+    [spdy fetch:[url absoluteString] delegate:self.delegate];
+    CFRunLoopRun();
+    NSTimeInterval coldLatency = -[start timeIntervalSinceNow];
+    STAssertTrue(self.delegate.closeCalled, @"Error: %@", self.delegate.error);
+    [spdy closeAllSessions];
+
+    STAssertFalse([spdy isSessionReadyForURL:url], @"Sessions were closed.");
+    [spdy preconnect:[NSArray arrayWithObject:url] warmUp:YES];
+    STAssertTrue(RunLoopUntil(^{ return [spdy isSessionReadyForURL:url]; }, 5), @"Preconnected session is ready.");
+
+    self.delegate = [[[E2ECallback alloc] init] autorelease];
+    start = [NSDate date];
+    [spdy fetch:[url absoluteString] delegate:self.delegate];
+    CFRunLoopRun();
+    NSTimeInterval warmLatency = -[start timeIntervalSinceNow];
+    STAssertTrue(self.delegate.closeCalled, @"Error: %@", self.delegate.error);
+    NSLog(@"First request latency: cold %fs, preconnected %fs", coldLatency, warmLatency);
+    [spdy closeAllSessions];
+}
+
+- (void)testPreconnectUnusedSessionIsClosed {
+    SPDY *spdy = [SPDY sharedSPDY];
+    NSURL *url = [NSURL URLWithString:@"https://localhost:9793/"];
+    NSTimeInterval oldTimeout = spdy.preconnectTimeout;
+    [spdy closeAllSessions];
+
+    spdy.preconnectTimeout = 0.5;
+    [spdy preconnect:[NSArray arrayWithObject:url]];
+    STAssertTrue(RunLoopUntil(^{ return [spdy isSessionReadyForURL:url]; }, 5), @"Preconnected session is ready.");
+    STAssertTrue(RunLoopUntil(^{ return (BOOL)![spdy isSessionReadyForURL:url]; }, 5), @"Unused session was closed.");
+    spdy.preconnectTimeout = oldTimeout;
+}
+
+- (void)testCoalescedFetches {
+    SPDY *spdy = [SPDY sharedSPDY];
+    NSURL *url = [NSURL URLWithString:@"https://localhost:9793/"];
+    [spdy closeAllSessions];
+    spdy.coalesceRequests = YES;
+    E2ECallback *second = [[[E2ECallback alloc] init] autorelease];
+    [spdy fetch:[url absoluteString] delegate:self.delegate];
+    [spdy fetch:[url absoluteString] delegate:second];
+    CFRunLoopRun();
+    STAssertTrue(self.delegate.closeCalled, @"Error: %@", self.delegate.error);
+    STAssertTrue(second.closeCalled, @"Both requests are closed by the same stream close.");
+    STAssertTrue(second.responseHeaders != NULL, @"");
+
+    SpdySessionKey *key = [[[SpdySessionKey alloc] initFromUrl:url] autorelease];
+    SpdySession *session = [spdy.sessions objectForKey:key];
+    STAssertNotNil(session, @"");
+    STAssertEquals(session.streamCount, 1U, @"Both fetches were sent as one stream.");
+    [spdy closeAllSessions];
+}
+
+// spdyd's test certificate (SPDYTests/testdata) covers localhost and the ip address 127.0.0.1, so both hosts reach the
+// same spdyd without any dns lookups off the machine.
+- (void)testCoalescedOrigins {
+    SPDY *spdy = [SPDY sharedSPDY];
+    NSURL *first = [NSURL URLWithString:@"https://localhost:9793/"];
+    NSURL *second = [NSURL URLWithString:@"https://127.0.0.1:9793/"];
+    [spdy closeAllSessions];
+    spdy.coalesceOrigins = YES;
+
+    [spdy fetch:[first absoluteString] delegate:self.delegate];
+    CFRunLoopRun();
+    STAssertTrue(self.delegate.closeCalled, @"Error: %@", self.delegate.error);
+
+    self.delegate = [[[E2ECallback alloc] init] autorelease];
+    [spdy fetch:[second absoluteString] delegate:self.delegate];
+    CFRunLoopRun();
+    STAssertTrue(self.delegate.closeCalled, @"Error: %@", self.delegate.error);
+
+    SpdySessionKey *firstKey = [[[SpdySessionKey alloc] initFromUrl:first] autorelease];
+    SpdySessionKey *secondKey = [[[SpdySessionKey alloc] initFromUrl:second] autorelease];
+    STAssertNotNil([spdy.sessions objectForKey:firstKey], @"");
+    STAssertEquals([spdy.sessions objectForKey:firstKey], [spdy.sessions objectForKey:secondKey], @"Both hosts share a session.");
+
+    [spdy closeAllSessionsForURL:second];
+    STAssertEquals([spdy.sessions count], 0U, @"Closing one host closes the shared session for both.");
+}
+
 - (void)testRegisteredForSpdy {
     SPDY *spdy = [SPDY sharedSPDY];
     NSURL *url = [NSURL URLWithString:@"https://a.ca"];
@@ -0,0 +1,206 @@
+//
+//  SpdyCoalescedRequestTests.m
+//  Tests fanning one stream out to several request callbacks.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyCoalescedRequestTests.h"
+#import "SpdyCoalescedRequest.h"
+#import "SPDY.h"
+
+// Stands in for the shared SpdyStream.
+@interface FakeStreamIdentifier : NSObject<SpdyRequestIdentifier>
+@property (assign) BOOL closed;
+@end
+
+@implementation FakeStreamIdentifier
+@synthesize closed = _closed;
+
+- (NSURL *)url {
+    return [NSURL URLWithString:@"https://example.com/image.png"];
+}
+
+- (void)close {
+    self.closed = YES;
+}
+@end
+
+@interface CoalescedTestCallback : RequestCallback
+@property (retain) id<SpdyRequestIdentifier> identifier;
+@property (assign) BOOL gotHeaders;
+@property (assign) size_t bytesRead;
+@property (assign) BOOL closeCalled;
+@property (retain) NSError *error;
+@end
+
+@implementation CoalescedTestCallback
+@synthesize identifier = _identifier;
+@synthesize gotHeaders = _gotHeaders;
+@synthesize bytesRead = _bytesRead;
+@synthesize closeCalled = _closeCalled;
+@synthesize error = _error;
+
+- (void)dealloc {
+    [_identifier release];
+    [_error release];
+    [super dealloc];
+}
+
+- (void)onConnect:(id<SpdyRequestIdentifier>)identifier {
+    self.identifier = identifier;
+}
+
+- (void)onResponseHeaders:(CFHTTPMessageRef)headers {
+    self.gotHeaders = YES;
+}
+
+- (size_t)onResponseData:(const uint8_t *)bytes length:(size_t)length {
+    self.bytesRead += length;
+    return length;
+}
+
+- (void)onStreamClose {
+    self.closeCalled = YES;
+}
+
+- (void)onError:(NSError *)error {
+    self.error = error;
+}
+@end
+
+@implementation SpdyCoalescedRequestTests {
+    NSMutableDictionary *table;
+    NSURL *url;
+    NSString *key;
+    CFHTTPMessageRef headers;
+}
+
+- (void)setUp {
+    table = [[NSMutableDictionary alloc] init];
+    url = [[NSURL URLWithString:@"https://example.com/image.png"] retain];
+    key = [[SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:nil varyHeaders:nil] retain];
+    headers = CFHTTPMessageCreateResponse(NULL, 200, CFSTR("OK"), kCFHTTPVersion1_1);
+}
+
+- (void)tearDown {
+    [table release];
+    [url release];
+    [key release];
+    CFRelease(headers);
+}
+
+- (SpdyCoalescedRequest *)newSharedRequest {
+    SpdyCoalescedRequest *shared = [[SpdyCoalescedRequest alloc] initWithKey:key url:url table:table];
+    [table setObject:shared forKey:key];
+    return shared;
+}
+
+- (void)testKeys {
+    NSArray *vary = [NSArray arrayWithObjects:@"accept", @"cookie", nil];
+    NSDictionary *a = [NSDictionary dictionaryWithObjectsAndKeys:@"image/*", @"Accept", @"1", @"X-Request-Id", nil];
+    NSDictionary *b = [NSDictionary dictionaryWithObjectsAndKeys:@"image/*", @"accept", @"2", @"X-Request-Id", nil];
+    NSDictionary *c = [NSDictionary dictionaryWithObjectsAndKeys:@"image/*", @"Accept", @"a=b", @"Cookie", nil];
+    NSString *keyA = [SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:a varyHeaders:vary];
+    STAssertEqualObjects(keyA, [SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:b varyHeaders:vary], @"Only vary headers matter.");
+    STAssertFalse([keyA isEqualToString:[SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:c varyHeaders:vary]], @"");
+    STAssertFalse([keyA isEqualToString:[SpdyCoalescedRequest keyForUrl:url method:@"HEAD" headers:a varyHeaders:vary]], @"");
+    STAssertFalse([keyA isEqualToString:[SpdyCoalescedRequest keyForUrl:[NSURL URLWithString:@"https://example.com/other.png"] method:@"GET" headers:a varyHeaders:vary]], @"");
+}
+
+- (void)testKeyWithMixedCaseVaryHeaders {
+    NSArray *vary = [NSArray arrayWithObjects:@"Authorization", @"COOKIE", nil];
+    NSDictionary *a = [NSDictionary dictionaryWithObjectsAndKeys:@"Basic YTpi", @"authorization", @"a=b", @"Cookie", nil];
+    NSDictionary *b = [NSDictionary dictionaryWithObjectsAndKeys:@"Basic Yzpk", @"authorization", @"a=b", @"Cookie", nil];
+    NSDictionary *c = [NSDictionary dictionaryWithObjectsAndKeys:@"Basic YTpi", @"Authorization", @"c=d", @"cookie", nil];
+    NSString *keyA = [SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:a varyHeaders:vary];
+    STAssertFalse([keyA isEqualToString:[SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:b varyHeaders:vary]], @"Different credentials.");
+    STAssertFalse([keyA isEqualToString:[SpdyCoalescedRequest keyForUrl:url method:@"GET" headers:c varyHeaders:vary]], @"Different cookies.");
+}
+
+- (void)testRangedAndConditionalRequestsAreNotCoalesced {
+    STAssertTrue([SpdyCoalescedRequest canCoalesceHeaders:nil], @"");
+    STAssertTrue([SpdyCoalescedRequest canCoalesceHeaders:[NSDictionary dictionaryWithObject:@"image/*" forKey:@"Accept"]], @"");
+    STAssertFalse([SpdyCoalescedRequest canCoalesceHeaders:[NSDictionary dictionaryWithObject:@"bytes=0-99" forKey:@"Range"]], @"");
+    STAssertFalse([SpdyCoalescedRequest canCoalesceHeaders:[NSDictionary dictionaryWithObject:@"\"abc\"" forKey:@"If-None-Match"]], @"");
+    STAssertFalse([SpdyCoalescedRequest canCoalesceHeaders:[NSDictionary dictionaryWithObject:@"Sat, 29 Oct 1994 19:43:31 GMT" forKey:@"if-modified-since"]], @"");
+}
+
+- (void)testFanOut {
+    SpdyCoalescedRequest *shared = [self newSharedRequest];
+    CoalescedTestCallback *first = [[[CoalescedTestCallback alloc] init] autorelease];
+    CoalescedTestCallback *second = [[[CoalescedTestCallback alloc] init] autorelease];
+    STAssertTrue([shared addWaiter:first], @"");
+    FakeStreamIdentifier *stream = [[[FakeStreamIdentifier alloc] init] autorelease];
+    [shared onConnect:stream];
+    STAssertTrue([shared addWaiter:second], @"Waiters can join after the stream is sent.");
+    STAssertNotNil(first.identifier, @"");
+    STAssertNotNil(second.identifier, @"");
+    STAssertTrue(first.identifier != second.identifier, @"Each waiter has its own identifier.");
+    STAssertEqualObjects([second.identifier url], url, @"");
+
+    [shared onResponseHeaders:headers];
+    STAssertNil([table objectForKey:key], @"The response started so no one else may join.");
+    STAssertFalse([shared addWaiter:[[[CoalescedTestCallback alloc] init] autorelease]], @"");
+    [shared onResponseData:(const uint8_t *)"1234" length:4];
+    [shared onStreamClose];
+
+    STAssertTrue(first.gotHeaders && second.gotHeaders, @"");
+    STAssertEquals(first.bytesRead, (size_t)4, @"");
+    STAssertEquals(second.bytesRead, (size_t)4, @"");
+    STAssertTrue(first.closeCalled && second.closeCalled, @"");
+    STAssertFalse(stream.closed, @"");
+    [shared release];
+}
+
+- (void)testCancelOneWaiter {
+    SpdyCoalescedRequest *shared = [self newSharedRequest];
+    CoalescedTestCallback *first = [[[CoalescedTestCallback alloc] init] autorelease];
+    CoalescedTestCallback *second = [[[CoalescedTestCallback alloc] init] autorelease];
+    [shared addWaiter:first];
+    [shared addWaiter:second];
+    FakeStreamIdentifier *stream = [[[FakeStreamIdentifier alloc] init] autorelease];
+    [shared onConnect:stream];
+
+    [first.identifier close];
+    STAssertEquals(first.error.code, kSpdyRequestCancelled, @"");
+    STAssertFalse(stream.closed, @"The other waiter still needs the stream.");
+    STAssertEquals(shared.waiterCount, 1U, @"");
+
+    [shared onResponseHeaders:headers];
+    [shared onResponseData:(const uint8_t *)"1234" length:4];
+    STAssertFalse(first.gotHeaders, @"");
+    STAssertEquals(second.bytesRead, (size_t)4, @"");
+
+    [second.identifier close];
+    STAssertEquals(second.error.code, kSpdyRequestCancelled, @"");
+    STAssertTrue(stream.closed, @"The last waiter cancels the stream.");
+    [shared release];
+}
+
+- (void)testErrorReachesAllWaiters {
+    SpdyCoalescedRequest *shared = [self newSharedRequest];
+    CoalescedTestCallback *first = [[[CoalescedTestCallback alloc] init] autorelease];
+    CoalescedTestCallback *second = [[[CoalescedTestCallback alloc] init] autorelease];
+    [shared addWaiter:first];
+    [shared addWaiter:second];
+    [shared onError:[NSError errorWithDomain:kSpdyErrorDomain code:kSpdyConnectionFailed userInfo:nil]];
+    STAssertEquals(first.error.code, kSpdyConnectionFailed, @"");
+    STAssertEquals(second.error.code, kSpdyConnectionFailed, @"");
+    STAssertNil([table objectForKey:key], @"");
+    STAssertFalse([shared addWaiter:first], @"");
+    [shared release];
+}
+
+@end
@@ -0,0 +1,179 @@
+//
+//  SpdyPushCacheTests.m
+//  Tests for the push cache, driven without a session by calling the pushed response callbacks directly.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyPushCacheTests.h"
+#import "SpdyPushCache.h"
+#import "SPDY.h"
+
+@interface PushTestCallback : RequestCallback
+@property (assign) NSInteger statusCode;
+@property (retain) NSMutableData *responseBody;
+@property (retain) id<SpdyRequestIdentifier> identifier;
+@property (assign) BOOL closeCalled;
+@end
+
+@implementation PushTestCallback
+@synthesize statusCode = _statusCode;
+@synthesize responseBody = _responseBody;
+@synthesize identifier = _identifier;
+@synthesize closeCalled = _closeCalled;
+
+- (void)dealloc {
+    [_responseBody release];
+    [_identifier release];
+    [super dealloc];
+}
+
+- (void)onConnect:(id<SpdyRequestIdentifier>)identifier {
+    self.identifier = identifier;
+}
+
+- (void)onResponseHeaders:(CFHTTPMessageRef)headers {
+    self.statusCode = CFHTTPMessageGetResponseStatusCode(headers);
+    self.responseBody = [NSMutableData data];
+}
+
+- (size_t)onResponseData:(const uint8_t *)bytes length:(size_t)length {
+    [self.responseBody appendBytes:bytes length:length];
+    return length;
+}
+
+- (void)onStreamClose {
+    self.closeCalled = YES;
+}
+@end
+
+@interface SPDY (SpdyPushCacheTests)
+@property (nonatomic, retain) SpdyPushCache *pushCache;
+@end
+
+@implementation SpdyPushCacheTests {
+    SpdyPushCache *cache;
+    NSURL *parent;
+    NSURL *pushed;
+    CFHTTPMessageRef headers;
+}
+
+- (void)setUp {
+    cache = [[SpdyPushCache alloc] initWithMaxBytes:16 maxEntries:2];
+    parent = [[NSURL URLWithString:@"https://example.com/index.html"] retain];
+    pushed = [[NSURL URLWithString:@"https://example.com/style.css"] retain];
+    headers = CFHTTPMessageCreateResponse(NULL, 200, CFSTR("OK"), kCFHTTPVersion1_1);
+}
+
+- (void)tearDown {
+    [cache release];
+    [parent release];
+    [pushed release];
+    CFRelease(headers);
+}
+
+// Lets the cache attach claimed pushes.
+- (void)runLoop {
+    CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0, false);
+}
+
+- (void)testClaimCompletedPush {
+    SpdyPushedResponse *push = [cache addPush:pushed associatedUrl:parent];
+    STAssertNotNil(push, @"");
+    STAssertEqualObjects(push.associatedUrl, parent, @"");
+    [push onResponseHeaders:headers];
+    [push onResponseData:(const uint8_t *)"body{}" length:6];
+    [push onStreamClose];
+    STAssertEquals([cache metrics].bufferedBytes, 6U, @"");
+
+    PushTestCallback *delegate = [[[PushTestCallback alloc] init] autorelease];
+    STAssertFalse([cache claim:parent delegate:delegate], @"Only pushed urls are in the cache.");
+    STAssertTrue([cache claim:pushed delegate:delegate], @"");
+    STAssertFalse([cache claim:pushed delegate:delegate], @"A push is only used once.");
+    [self runLoop];
+    STAssertTrue(delegate.closeCalled, @"");
+    STAssertEquals(delegate.statusCode, 200, @"");
+    STAssertEqualObjects(delegate.responseBody, [NSData dataWithBytes:"body{}" length:6], @"");
+    STAssertEqualObjects([delegate.identifier url], pushed, @"");
+
+    SpdyPushMetrics metrics = [cache metrics];
+    STAssertEquals(metrics.pushedStreams, 1U, @"");
+    STAssertEquals(metrics.claimedStreams, 1U, @"");
+    STAssertEquals(metrics.bufferedBytes, 0U, @"");
+    STAssertEquals(metrics.unusedBytes, 0U, @"");
+}
+
+- (void)testClaimInProgressPush {
+    SpdyPushedResponse *push = [cache addPush:pushed associatedUrl:parent];
+    [push onResponseHeaders:headers];
+    [push onResponseData:(const uint8_t *)"body" length:4];
+
+    PushTestCallback *delegate = [[[PushTestCallback alloc] init] autorelease];
+    STAssertTrue([cache claim:pushed delegate:delegate], @"");
+    [self runLoop];
+    STAssertFalse(delegate.closeCalled, @"The push is still being received.");
+    [push onResponseData:(const uint8_t *)"{}" length:2];
+    [push onStreamClose];
+    STAssertTrue(delegate.closeCalled, @"");
+    STAssertEqualObjects(delegate.responseBody, [NSData dataWithBytes:"body{}" length:6], @"");
+}
+
+- (void)testUnusedPushesAreDropped {
+    SpdyPushedResponse *first = [cache addPush:pushed associatedUrl:parent];
+    [first onResponseData:(const uint8_t *)"0123456789" length:10];
+    SpdyPushedResponse *second = [cache addPush:[NSURL URLWithString:@"https://example.com/a.js"] associatedUrl:parent];
+    [second onResponseData:(const uint8_t *)"0123456789" length:10];
+
+    SpdyPushMetrics metrics = [cache metrics];
+    STAssertEquals(metrics.droppedStreams, 1U, @"The oldest push is dropped when over maxBytes.");
+    STAssertEquals(metrics.unusedBytes, 10U, @"");
+    STAssertEquals(metrics.bufferedBytes, 10U, @"");
+    STAssertFalse([cache claim:pushed delegate:[[[PushTestCallback alloc] init] autorelease]], @"");
+
+    [cache addPush:[NSURL URLWithString:@"https://example.com/b.js"] associatedUrl:parent];
+    [cache addPush:[NSURL URLWithString:@"https://example.com/c.js"] associatedUrl:parent];
+    metrics = [cache metrics];
+    STAssertEquals(metrics.droppedStreams, 2U, @"Only maxEntries pushes are kept.");
+    STAssertEquals(metrics.unusedBytes, 20U, @"");
+}
+
+// A fetch through SPDY is answered from the push cache without opening a session.
+- (void)testFetchUsesPushCache {
+    SPDY *spdy = [SPDY sharedSPDY];
+    BOOL wasEnabled = spdy.serverPushEnabled;
+    spdy.serverPushEnabled = YES;
+    SpdyPushedResponse *push = [spdy.pushCache addPush:pushed associatedUrl:parent];
+    [push onResponseHeaders:headers];
+    [push onResponseData:(const uint8_t *)"body{}" length:6];
+    [push onStreamClose];
+
+    PushTestCallback *delegate = [[[PushTestCallback alloc] init] autorelease];
+    [spdy fetch:[pushed absoluteString] delegate:delegate];
+    [self runLoop];
+    spdy.serverPushEnabled = wasEnabled;
+    STAssertTrue(delegate.closeCalled, @"");
+    STAssertEquals(delegate.statusCode, 200, @"");
+    STAssertEqualObjects(delegate.responseBody, [NSData dataWithBytes:"body{}" length:6], @"");
+    STAssertTrue([spdy pushMetrics].claimedStreams > 0, @"");
+}
+
+- (void)testFailedPushIsDropped {
+    SpdyPushedResponse *push = [cache addPush:pushed associatedUrl:parent];
+    [push onResponseData:(const uint8_t *)"01" length:2];
+    [push onError:[NSError errorWithDomain:kSpdyErrorDomain code:kSpdyRequestCancelled userInfo:nil]];
+    STAssertFalse([cache claim:pushed delegate:[[[PushTestCallback alloc] init] autorelease]], @"");
+    STAssertEquals([cache metrics].unusedBytes, 2U, @"");
+}
+
+@end
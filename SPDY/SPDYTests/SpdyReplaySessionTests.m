@@ -0,0 +1,111 @@
+//
+//  SpdyReplaySessionTests.m
+//  Captures a session against spdyd and replays it without the network.
+//
+//  Copyright (c) 2026 Twist Inc.
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+// http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#import "SpdyReplaySessionTests.h"
+#import "SpdyReplaySession.h"
+#import "SPDY.h"
+
+@interface ReplayCallback : RequestCallback
+@property (assign) BOOL closeCalled;
+@property (assign) NSInteger statusCode;
+@property (assign) size_t bytesRead;
+@property (retain) NSError *error;
+@end
+
+@implementation ReplayCallback
+@synthesize closeCalled = _closeCalled;
+@synthesize statusCode = _statusCode;
+@synthesize bytesRead = _bytesRead;
+@synthesize error = _error;
+
+- (void)dealloc {
+    [_error release];
+    [super dealloc];
+}
+
+- (void)onResponseHeaders:(CFHTTPMessageRef)headers {
+    self.statusCode = CFHTTPMessageGetResponseStatusCode(headers);
+}
+
+- (size_t)onResponseData:(const uint8_t *)bytes length:(size_t)length {
+    self.bytesRead += length;
+    return length;
+}
+
+- (void)onStreamClose {
+    self.closeCalled = YES;
+    CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
+- (void)onError:(NSError *)error {
+    self.error = error;
+    CFRunLoopPerformBlock(CFRunLoopGetCurrent(), kCFRunLoopCommonModes, ^{ CFRunLoopStop(CFRunLoopGetCurrent()); });
+}
+@end
+
+@implementation SpdyReplaySessionTests {
+    NSString *captureDirectory;
+}
+
+- (void)setUp {
+    captureDirectory = [[NSTemporaryDirectory() stringByAppendingPathComponent:@"spdy-replay-tests"] retain];
+    [[NSFileManager defaultManager] removeItemAtPath:captureDirectory error:nil];
+    [[NSFileManager defaultManager] createDirectoryAtPath:captureDirectory withIntermediateDirectories:YES attributes:nil error:nil];
+}
+
+- (void)tearDown {
+    [SPDY sharedSPDY].captureDirectory = nil;
+    [[NSFileManager defaultManager] removeItemAtPath:captureDirectory error:nil];
+    [captureDirectory release];
+}
+
+- (void)testNotACapture {
+    const char notCapture[] = "HTTP/1.1 200 OK\r\n";
+    STAssertNil([[SpdyReplaySession alloc] initWithCapture:[NSData dataWithBytes:notCapture length:sizeof(notCapture)]], @"Bad magic");
+    STAssertNil([[SpdyReplaySession alloc] initWithCapture:[NSData data]], @"Too short");
+    STAssertNil([SpdyReplaySession newFromCaptureFile:[captureDirectory stringByAppendingPathComponent:@"missing"]], @"No file");
+}
+
+- (void)testCaptureAndReplay {
+    NSURL *url = [NSURL URLWithString:@"https://localhost:9793/"];
+    // Sessions are only captured when they are created, so don't reuse one left open by another test.
+    [[SPDY sharedSPDY] closeAllSessions];
+    [SPDY sharedSPDY].captureDirectory = captureDirectory;
+    ReplayCallback *live = [[[ReplayCallback alloc] init] autorelease];
+    [[SPDY sharedSPDY] fetch:[url absoluteString] delegate:live];
+    CFRunLoopRun();
+    [[SPDY sharedSPDY] closeAllSessionsForURL:url];
+    STAssertTrue(live.closeCalled, @"Error: %@", live.error);
+
+    NSArray *captures = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:captureDirectory error:nil];
+    STAssertEquals([captures count], 1U, @"One session captured: %@", captures);
+    NSString *path = [captureDirectory stringByAppendingPathComponent:[captures lastObject]];
+    SpdyReplaySession *replay = [SpdyReplaySession newFromCaptureFile:path];
+    STAssertNotNil(replay, @"Capture %@ can be read", path);
+
+    ReplayCallback *replayed = [[[ReplayCallback alloc] init] autorelease];
+    [replay fetch:url delegate:replayed];
+    STAssertEquals([replay replay], 0, @"The whole capture was replayed");
+    STAssertTrue(replayed.closeCalled, @"Error: %@", replayed.error);
+    STAssertEquals(replayed.statusCode, live.statusCode, @"");
+    STAssertEquals(replayed.bytesRead, live.bytesRead, @"");
+    STAssertTrue(replay.bytesSent > 0, @"The SYN_STREAM was sent to the replay transport");
+    [replay release];
+}
+
+@end
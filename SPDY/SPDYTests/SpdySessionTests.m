@@ -19,6 +19,7 @@
 
 #import "SpdySessionTests.h"
 #import "SpdySession.h"
+#import "SpdyPushCache.h"
 #import "SPDY.h"
 
 @interface SpdySessionTestDelegate : RequestCallback
@@ -74,4 +75,39 @@
     [session release];
 }
 
+- (void)testCertificateAddressMatchesHost {
+    const uint8_t loopback[] = {127, 0, 0, 1};
+    NSData *address = [NSData dataWithBytes:loopback length:sizeof(loopback)];
+    STAssertTrue([SpdySession certificateAddress:address matchesHost:@"127.0.0.1"], @"");
+    STAssertFalse([SpdySession certificateAddress:address matchesHost:@"127.0.0.2"], @"");
+    STAssertFalse([SpdySession certificateAddress:address matchesHost:@"localhost"], @"Only ip addresses match.");
+    STAssertFalse([SpdySession certificateAddress:[NSData dataWithBytes:loopback length:2] matchesHost:@"127.0.0.1"], @"");
+}
+
+- (void)testCanAcceptPush {
+    SpdySession *session = [[[SpdySession alloc] init] autorelease];
+    session.host = [NSURL URLWithString:@"https://example.com/"];
+    NSURL *sameOrigin = [NSURL URLWithString:@"https://example.com/style.css"];
+    STAssertFalse([session canAcceptPush:sameOrigin], @"Pushes are refused without a push cache.");
+
+    session.pushCache = [[[SpdyPushCache alloc] initWithMaxBytes:1024 maxEntries:4] autorelease];
+    STAssertTrue([session canAcceptPush:sameOrigin], @"");
+    STAssertTrue([session canAcceptPush:[NSURL URLWithString:@"HTTPS://Example.COM/style.css"]], @"Scheme and host are case insensitive.");
+    STAssertTrue([session canAcceptPush:[NSURL URLWithString:@"https://example.com:443/style.css"]], @"443 is the https port.");
+    STAssertFalse([session canAcceptPush:[NSURL URLWithString:@"http://example.com/style.css"]], @"Different scheme.");
+    STAssertFalse([session canAcceptPush:[NSURL URLWithString:@"https://example.com:8443/style.css"]], @"Different port.");
+    STAssertFalse([session canAcceptPush:[NSURL URLWithString:@"https://other.example.com/style.css"]], @"Different host.");
+    STAssertFalse([session canAcceptPush:[NSURL URLWithString:@"/style.css"]], @"No origin.");
+}
+
+- (void)testCertificateNameMatchesHost {
+    STAssertTrue([SpdySession certificateName:@"www.example.com" matchesHost:@"www.example.com"], @"");
+    STAssertTrue([SpdySession certificateName:@"WWW.Example.com" matchesHost:@"www.example.COM"], @"Names are case insensitive.");
+    STAssertFalse([SpdySession certificateName:@"www.example.com" matchesHost:@"example.com"], @"");
+    STAssertTrue([SpdySession certificateName:@"*.example.com" matchesHost:@"img1.example.com"], @"");
+    STAssertFalse([SpdySession certificateName:@"*.example.com" matchesHost:@"example.com"], @"The wildcard needs a label.");
+    STAssertFalse([SpdySession certificateName:@"*.example.com" matchesHost:@"a.b.example.com"], @"The wildcard is only one label.");
+    STAssertFalse([SpdySession certificateName:@"*.example.com" matchesHost:@"img1.example.org"], @"");
+}
+
 @end
@@ -127,6 +127,18 @@ static int countItems(const char **nv) {
     STAssertEquals(0, strcmp(nv[7], "bar"), @"No www here.");
 }
     
+- (void)testUrlFromPushHeaders {
+    const char *nv[] = {":status", "200 OK", ":scheme", "https", ":host", "example.com:8443", ":path", "/a.css?x=1", NULL};
+    NSURL *url = [SpdyStream urlFromPushHeaders:nv];
+    STAssertEqualObjects([url absoluteString], @"https://example.com:8443/a.css?x=1", @"");
+
+    const char *spdy2[] = {"url", "https://example.com/b.js", "status", "200 OK", NULL};
+    STAssertEqualObjects([[SpdyStream urlFromPushHeaders:spdy2] absoluteString], @"https://example.com/b.js", @"");
+
+    const char *noPath[] = {":scheme", "https", ":host", "example.com", NULL};
+    STAssertNil([SpdyStream urlFromPushHeaders:noPath], @"A pushed url needs a path.");
+}
+
 - (void)testCloseStream {
     stream = [SpdyStream newFromNSURL:self.url delegate:self.delegate];
     [stream closeStream];
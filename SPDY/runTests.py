@@ -13,10 +13,10 @@ import time
 _PORT = 9793
 
 
-def _run_server(builddir, testdata, port):
+def _run_server(builddir, testdata, certdir, port):
   base_args = ['%s/spdyd' % builddir, '-d', os.path.normpath(testdata), '-v']
-  base_args.extend([str(port), '%s/privkey.pem' % testdata,
-                    '%s/cacert.pem' % testdata])
+  base_args.extend([str(port), '%s/privkey.pem' % certdir,
+                    '%s/cacert.pem' % certdir])
   return subprocess.Popen(base_args, stdout=open('/tmp/spdyd-log', 'w'))
 
 def _check_server_up(builddir, port):
@@ -40,8 +40,11 @@ def _kill_server(server):
 def main(basedir, test_driver):
   builddir = basedir + '/../build/native/bin'
   datadir = basedir + '/../spdylay/tests/testdata'
+  # The certificate covers localhost and 127.0.0.1, so that tests can reach
+  # the server under two hostnames.
+  certdir = basedir + '/SPDYTests/testdata'
   result = -2
-  server = _run_server(builddir, datadir, _PORT)
+  server = _run_server(builddir, datadir, certdir, _PORT)
   _check_server_up(builddir, _PORT)
   try:
     result = subprocess.call([test_driver])